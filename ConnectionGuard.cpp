@@ -0,0 +1,298 @@
+#include "ConnectionGuard.h"
+#include "FauxMoProtocol.h"
+
+//*** timer wheel geometry - 128 slots of 100ms covers 12.8s ***
+const int WHEEL_TICK_MS = 100;
+const int WHEEL_SLOTS   = 128;
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief appendAvailable - reads straight into the end of the buffer, which
+ *        only allocates if it has to grow
+ * @param sock
+ * @param buffer
+ */
+//*****************************************************************************
+static void appendAvailable( QTcpSocket *sock, QByteArray &buffer )
+{
+    qint64 avail = qMin( sock->bytesAvailable(), qint64(1) << 24 );
+    if ( avail <= 0 ) return;
+
+    int used = buffer.size();
+    buffer.resize( used + int(avail) );
+
+    qint64 got = sock->read( buffer.data() + used, avail );
+    buffer.resize( used + int( qMax( got, qint64(0) ) ) );
+}
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief ConnectionGuard::ConnectionGuard
+ * @param parent
+ */
+//*****************************************************************************
+ConnectionGuard::ConnectionGuard( QObject *parent )
+    : QObject(parent),
+      cursor_(0),
+      nextId_(1)
+{
+    //*** one wheel for all sockets ***
+    wheel_.resize( WHEEL_SLOTS );
+
+    tickTimer_.setInterval( WHEEL_TICK_MS );
+    connect( &tickTimer_, SIGNAL(timeout()), SLOT(tick()) );
+
+    clock_.start();
+}
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief ConnectionGuard::admit - checks limits for a new connection
+ * @param sock - newly accepted socket
+ * @param owner - device that accepted it
+ * @return - true if admitted, false if rejected (socket aborted)
+ */
+//*****************************************************************************
+bool ConnectionGuard::admit( QTcpSocket *sock, QObject *owner )
+{
+    //*** check global cap ***
+    if ( records_.size() >= limits_.maxConnections )
+    {
+        stats_.rejectedGlobalLimit++;
+        expire( sock );
+        return false;
+    }
+
+    //*** check per device cap ***
+    if ( perOwner_.value( owner ) >= limits_.maxConnectionsPerDevice )
+    {
+        stats_.rejectedDeviceLimit++;
+        expire( sock );
+        return false;
+    }
+
+    //*** track it ***
+    Record rec;
+    rec.id             = nextId_++;
+    rec.sock           = sock;
+    rec.owner          = owner;
+    rec.acceptedMs     = clock_.elapsed();
+    rec.lastActivityMs = rec.acceptedMs;
+
+    records_.insert( sock, rec );
+    perOwner_[owner]++;
+    stats_.accepted++;
+
+    schedule( rec );
+
+    //*** stop tracking when it goes away - pooled sockets come back, connect once ***
+    connect( sock, SIGNAL(disconnected()), SLOT(socketDisconnected()), Qt::UniqueConnection );
+    connect( sock, SIGNAL(destroyed(QObject*)), SLOT(socketGone(QObject*)), Qt::UniqueConnection );
+
+    if ( !tickTimer_.isActive() ) tickTimer_.start();
+
+    return true;
+}
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief ConnectionGuard::readRequest - buffers data until a full request
+ *        (headers + Content-Length body) is available
+ * @param sock - client socket
+ * @param buffer - kept by the caller between calls for this socket
+ * @param size - receives the length of the request at the start of buffer
+ * @return
+ */
+//*****************************************************************************
+ConnectionGuard::ReadResult ConnectionGuard::readRequest( QTcpSocket *sock, QByteArray &buffer, int &size )
+{
+    auto it = records_.find( sock );
+
+    //*** accumulate ***
+    appendAvailable( sock, buffer );
+
+    //*** not tracked - nothing to enforce ***
+    if ( it == records_.end() )
+    {
+        size = buffer.size();
+        return buffer.isEmpty() ? Incomplete : Complete;
+    }
+
+    Record &rec = it.value();
+    rec.lastActivityMs = clock_.elapsed();
+
+    //*** look for end of headers ***
+    int hdrEnd = buffer.indexOf( "\r\n\r\n" );
+    if ( hdrEnd < 0 )
+    {
+        if ( buffer.size() > limits_.maxHeaderBytes )
+        {
+            stats_.rejectedHeaderTooLarge++;
+            expire( sock );
+            return Rejected;
+        }
+        return Incomplete;
+    }
+
+    if ( hdrEnd > limits_.maxHeaderBytes )
+    {
+        stats_.rejectedHeaderTooLarge++;
+        expire( sock );
+        return Rejected;
+    }
+
+    //*** check body size ***
+    qint64 bodyLen = FauxMoProtocol::contentLength( buffer.constData(), hdrEnd );
+    if ( bodyLen > limits_.maxBodyBytes )
+    {
+        stats_.rejectedBodyTooLarge++;
+        expire( sock );
+        return Rejected;
+    }
+
+    //*** wait for the rest of the body ***
+    int total = hdrEnd + 4 + int(bodyLen);
+    if ( buffer.size() < total ) return Incomplete;
+
+    size = total;
+
+    return Complete;
+}
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief ConnectionGuard::schedule
+ * @param rec
+ */
+//*****************************************************************************
+void ConnectionGuard::schedule( const Record &rec )
+{
+    //*** earliest of idle and request deadlines ***
+    qint64 deadline = qMin( rec.lastActivityMs + limits_.idleTimeoutMs,
+                            rec.acceptedMs     + limits_.requestTimeoutMs );
+
+    qint64 ticks = ( deadline - clock_.elapsed() + WHEEL_TICK_MS - 1 ) / WHEEL_TICK_MS;
+    ticks = qBound( qint64(1), ticks, qint64(WHEEL_SLOTS - 1) );
+
+    WheelEntry entry;
+    entry.key = rec.sock;
+    entry.id  = rec.id;
+
+    wheel_[ ( cursor_ + int(ticks) ) % WHEEL_SLOTS ].append( entry );
+}
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief ConnectionGuard::tick - checks deadlines for the current slot,
+ *        reschedules connections that have seen activity since
+ */
+//*****************************************************************************
+void ConnectionGuard::tick()
+{
+QVector<WheelEntry> due;
+
+    cursor_ = ( cursor_ + 1 ) % WHEEL_SLOTS;
+    due.swap( wheel_[cursor_] );
+
+    qint64 now = clock_.elapsed();
+
+    foreach( auto entry, due )
+    {
+        auto it = records_.find( entry.key );
+
+        //*** gone or replaced since it was scheduled ***
+        if ( it == records_.end() || it.value().id != entry.id ) continue;
+
+        const Record &rec = it.value();
+
+        if ( now >= rec.acceptedMs + limits_.requestTimeoutMs )
+        {
+            stats_.requestTimeouts++;
+            expire( rec.sock );
+        }
+        else if ( now >= rec.lastActivityMs + limits_.idleTimeoutMs )
+        {
+            stats_.idleTimeouts++;
+            expire( rec.sock );
+        }
+        else
+        {
+            schedule( rec );
+        }
+    }
+
+    if ( records_.isEmpty() ) tickTimer_.stop();
+}
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief ConnectionGuard::expire - releases and aborts a socket, the pool
+ *        that owns it takes it back on disconnect
+ * @param sock
+ */
+//*****************************************************************************
+void ConnectionGuard::expire( QTcpSocket *sock )
+{
+    release( sock );
+
+    sock->abort();
+}
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief ConnectionGuard::release
+ * @param key
+ */
+//*****************************************************************************
+void ConnectionGuard::release( QObject *key )
+{
+    auto it = records_.find( key );
+    if ( it == records_.end() ) return;
+
+    //*** update device count ***
+    QObject *owner = it.value().owner;
+    if ( --perOwner_[owner] <= 0 ) perOwner_.remove( owner );
+
+    records_.erase( it );
+}
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief ConnectionGuard::socketDisconnected
+ */
+//*****************************************************************************
+void ConnectionGuard::socketDisconnected()
+{
+    release( sender() );
+}
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief ConnectionGuard::socketGone - socket deleted without disconnecting
+ * @param obj
+ */
+//*****************************************************************************
+void ConnectionGuard::socketGone( QObject *obj )
+{
+    release( obj );
+}
@@ -0,0 +1,162 @@
+#ifndef CONNECTIONGUARD_H
+#define CONNECTIONGUARD_H
+
+#include <QObject>
+#include <QTcpSocket>
+#include <QTimer>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QVector>
+#include <QByteArray>
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief The ConnectionLimits struct - admission and deadline settings
+ */
+//*****************************************************************************
+struct ConnectionLimits
+{
+    //*** max open connections across all devices ***
+    int maxConnections          = 256;
+
+    //*** max open connections for a single device ***
+    int maxConnectionsPerDevice = 16;
+
+    //*** max size of the request line + headers ***
+    int maxHeaderBytes          = 8192;
+
+    //*** max size of a request body (Content-Length) ***
+    int maxBodyBytes            = 16384;
+
+    //*** close a connection that sends nothing for this long ***
+    int idleTimeoutMs           = 5000;
+
+    //*** close a connection that has been open this long ***
+    int requestTimeoutMs        = 10000;
+};
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief The ConnectionStats struct - counters for accepted/rejected connections
+ */
+//*****************************************************************************
+struct ConnectionStats
+{
+    quint64 accepted               = 0;
+    quint64 rejectedGlobalLimit    = 0;
+    quint64 rejectedDeviceLimit    = 0;
+    quint64 rejectedHeaderTooLarge = 0;
+    quint64 rejectedBodyTooLarge   = 0;
+    quint64 idleTimeouts           = 0;
+    quint64 requestTimeouts        = 0;
+};
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief The ConnectionGuard class - shared by all devices, tracks every open
+ *        client socket, enforces connection caps and size limits, and expires
+ *        idle or slow connections from a single timer wheel
+ */
+//*****************************************************************************
+class ConnectionGuard : public QObject
+{
+    Q_OBJECT
+
+public:
+
+    //*** result of reading from a client socket ***
+    enum ReadResult
+    {
+        Incomplete,     // need more data
+        Complete,       // a full request is available
+        Rejected        // limit exceeded, socket has been aborted
+    };
+
+    //*** constructor ***
+    explicit ConnectionGuard( QObject *parent = nullptr );
+
+    //*** limits - apply before devices start accepting connections ***
+    void setLimits( const ConnectionLimits &limits ) { limits_ = limits; }
+    ConnectionLimits limits() const { return limits_; }
+
+    //*** counters ***
+    ConnectionStats stats() const { return stats_; }
+
+    //*** number of connections currently tracked ***
+    int openConnections() const { return records_.size(); }
+
+    //*** admits (and tracks) or rejects (and aborts) a new client socket ***
+    bool admit( QTcpSocket *sock, QObject *owner );
+
+    //*** appends available data to 'buffer', Complete once its first 'size' bytes are a full request ***
+    ReadResult readRequest( QTcpSocket *sock, QByteArray &buffer, int &size );
+
+
+private slots:
+
+    //*** timer wheel tick ***
+    void tick();
+
+    //*** socket went away ***
+    void socketGone( QObject *obj );
+    void socketDisconnected();
+
+
+private:
+
+    //*** per connection info ***
+    struct Record
+    {
+        quint64     id;
+        QTcpSocket *sock;
+        QObject    *owner;
+        qint64      acceptedMs;
+        qint64      lastActivityMs;
+    };
+
+    //*** entry in a wheel slot - id guards against reused pointers ***
+    struct WheelEntry
+    {
+        QObject *key;
+        quint64  id;
+    };
+
+    //*** puts a record in the slot for its next deadline ***
+    void schedule( const Record &rec );
+
+    //*** stops tracking a socket ***
+    void release( QObject *key );
+
+    //*** drops a socket that broke a rule ***
+    void expire( QTcpSocket *sock );
+
+    //*** current limits ***
+    ConnectionLimits limits_;
+
+    //*** counters ***
+    ConnectionStats stats_;
+
+    //*** open connections ***
+    QHash<QObject*,Record> records_;
+
+    //*** open connections per device ***
+    QHash<QObject*,int> perOwner_;
+
+    //*** timer wheel ***
+    QVector< QVector<WheelEntry> > wheel_;
+    int cursor_;
+    QTimer tickTimer_;
+
+    //*** monotonic time base ***
+    QElapsedTimer clock_;
+
+    //*** next record id ***
+    quint64 nextId_;
+};
+
+#endif // CONNECTIONGUARD_H
@@ -0,0 +1,238 @@
+#include "ConnectionPool.h"
+#include "FauxMoLog.h"
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief ConnectionPool::ConnectionPool
+ * @param parent
+ */
+//*****************************************************************************
+ConnectionPool::ConnectionPool( QObject *parent )
+    : QObject(parent),
+      maxIdle_(POOL_DEFAULT_MAX_IDLE)
+{
+}
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief ConnectionPool::~ConnectionPool
+ */
+//*****************************************************************************
+ConnectionPool::~ConnectionPool()
+{
+    foreach( auto conn, conns_ )
+    {
+        delete conn->sock;
+        delete conn;
+    }
+}
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief ConnectionPool::acquire - takes an idle connection object (or makes
+ *        one) and hands it the descriptor
+ * @param descriptor - accepted socket
+ * @param handler - gets the data and errors for this connection
+ * @return - socket, nullptr if the descriptor could not be used
+ */
+//*****************************************************************************
+QTcpSocket *ConnectionPool::acquire( qintptr descriptor, ConnectionHandler *handler )
+{
+PooledConnection *conn = nullptr;
+
+    if ( !idle_.isEmpty() )
+    {
+        conn = idle_.takeLast();
+        stats_.reused++;
+    }
+    else
+    {
+        conn = new PooledConnection;
+        conn->sock = new QTcpSocket;
+        conn->request.reserve( POOL_REQUEST_ARENA );
+        conn->response.reserve( POOL_RESPONSE_ARENA );
+
+        connect( conn->sock, SIGNAL(readyRead()), SLOT(socketReadyRead()) );
+        connect( conn->sock, SIGNAL(error(QAbstractSocket::SocketError)),
+                             SLOT(socketError(QAbstractSocket::SocketError)) );
+        connect( conn->sock, SIGNAL(disconnected()), SLOT(socketDisconnected()) );
+
+        conns_.insert( conn->sock, conn );
+        stats_.created++;
+    }
+
+    if ( !conn->sock->setSocketDescriptor( descriptor ) )
+    {
+        conn->active = false;
+        idle_.append( conn );
+        return nullptr;
+    }
+
+    conn->handler = handler;
+    conn->active  = true;
+
+    return conn->sock;
+}
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief ConnectionPool::requestDone
+ * @param conn
+ */
+//*****************************************************************************
+void ConnectionPool::requestDone( PooledConnection *conn )
+{
+    stats_.requests++;
+
+    //*** reserve() set the capacity, anything above it means the arena grew ***
+    if ( conn->request.capacity() > POOL_REQUEST_ARENA ||
+         conn->response.capacity() > POOL_RESPONSE_ARENA ) stats_.arenaGrowths++;
+
+    //*** resize keeps reserved capacity ***
+    conn->request.resize( 0 );
+    conn->response.resize( 0 );
+}
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief ConnectionPool::detach
+ * @param handler
+ */
+//*****************************************************************************
+void ConnectionPool::detach( ConnectionHandler *handler )
+{
+    foreach( auto conn, conns_ )
+    {
+        if ( conn->handler != handler ) continue;
+
+        if ( conn->active ) recycle( conn );
+    }
+}
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief ConnectionPool::socketReadyRead
+ */
+//*****************************************************************************
+void ConnectionPool::socketReadyRead()
+{
+    //*** records from here belong to the instance that owns the pool ***
+    FauxMoLogScope logScope( parent() );
+
+    PooledConnection *conn = conns_.value( sender() );
+
+    if ( conn && conn->handler ) conn->handler->connectionReadyRead( conn );
+}
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief ConnectionPool::socketError
+ * @param socketError
+ */
+//*****************************************************************************
+void ConnectionPool::socketError( QAbstractSocket::SocketError socketError )
+{
+    FauxMoLogScope logScope( parent() );
+
+    //*** don't worry about disconnects - they are expected ***
+    if ( socketError == QAbstractSocket::RemoteHostClosedError ) return;
+
+    PooledConnection *conn = conns_.value( sender() );
+
+    if ( conn && conn->handler ) conn->handler->connectionError( conn );
+}
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief ConnectionPool::socketDisconnected
+ */
+//*****************************************************************************
+void ConnectionPool::socketDisconnected()
+{
+    FauxMoLogScope logScope( parent() );
+
+    PooledConnection *conn = conns_.value( sender() );
+
+    if ( conn && conn->active ) recycle( conn );
+}
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief ConnectionPool::recycle - keeps the object unless enough are idle
+ * @param conn
+ */
+//*****************************************************************************
+void ConnectionPool::recycle( PooledConnection *conn )
+{
+    conn->active  = false;
+    conn->handler = nullptr;
+    conn->request.resize( 0 );
+    conn->response.resize( 0 );
+
+    //*** unconnected again, drops anything still buffered ***
+    conn->sock->abort();
+
+    if ( idle_.size() < maxIdle_ )
+    {
+        idle_.append( conn );
+        return;
+    }
+
+    //*** may be inside one of its own signals ***
+    conns_.remove( conn->sock );
+    conn->sock->deleteLater();
+    delete conn;
+
+    stats_.destroyed++;
+}
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief PooledTcpServer::PooledTcpServer
+ * @param pool
+ * @param handler
+ * @param parent
+ */
+//*****************************************************************************
+PooledTcpServer::PooledTcpServer( ConnectionPool *pool, ConnectionHandler *handler, QObject *parent )
+    : QTcpServer(parent),
+      pool_(pool),
+      handler_(handler)
+{
+}
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief PooledTcpServer::incomingConnection - queues a pooled socket for
+ *        nextPendingConnection
+ * @param descriptor
+ */
+//*****************************************************************************
+void PooledTcpServer::incomingConnection( qintptr descriptor )
+{
+    QTcpSocket *sock = pool_->acquire( descriptor, handler_ );
+
+    if ( sock ) addPendingConnection( sock );
+}
@@ -0,0 +1,172 @@
+#ifndef CONNECTIONPOOL_H
+#define CONNECTIONPOOL_H
+
+#include <QObject>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QAbstractSocket>
+#include <QHash>
+#include <QList>
+#include <QByteArray>
+
+//*** initial arena sizes - a Wemo request/response fits without growing ***
+const int POOL_REQUEST_ARENA    = 2048;
+const int POOL_RESPONSE_ARENA   = 4096;
+
+//*** idle connection objects kept for reuse ***
+const int POOL_DEFAULT_MAX_IDLE = 64;
+
+class ConnectionHandler;
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief The PooledConnection struct - a socket plus request/response arenas,
+ *        recycled between connections
+ */
+//*****************************************************************************
+struct PooledConnection
+{
+    QTcpSocket        *sock;
+    ConnectionHandler *handler;
+    bool               active;      // false while on the idle list
+
+    //*** arenas - emptied per request, capacity is kept ***
+    QByteArray request;
+    QByteArray response;
+};
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief The ConnectionHandler class - implemented by whatever serves the
+ *        connections accepted by a PooledTcpServer
+ */
+//*****************************************************************************
+class ConnectionHandler
+{
+public:
+
+    virtual ~ConnectionHandler() {}
+
+    //*** data arrived ***
+    virtual void connectionReadyRead( PooledConnection *conn ) = 0;
+
+    //*** socket error - remote close is filtered out ***
+    virtual void connectionError( PooledConnection *conn ) = 0;
+};
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief The ConnectionPoolStats struct - reuse and arena counters
+ */
+//*****************************************************************************
+struct ConnectionPoolStats
+{
+    quint64 requests        = 0;    // requests completed on pooled connections
+    quint64 created         = 0;    // connection objects allocated (pool misses)
+    quint64 reused          = 0;    // connections served by a recycled object
+    quint64 arenaGrowths    = 0;    // requests that grew an arena past its size
+    quint64 destroyed       = 0;    // freed because the idle list was full
+};
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief The ConnectionPool class - shared by all devices, recycles client
+ *        sockets and their buffers so the pool and the request path don't
+ *        allocate per connection (Qt's socket internals still do - see
+ *        fauxmo-bench --protocol and the allocs column of an engine run).
+ *        Socket signals are connected once per object.
+ */
+//*****************************************************************************
+class ConnectionPool : public QObject
+{
+    Q_OBJECT
+
+public:
+
+    //*** constructor ***
+    explicit ConnectionPool( QObject *parent = nullptr );
+
+    //*** destructor - deletes all connection objects ***
+    ~ConnectionPool();
+
+    //*** idle objects kept for reuse ***
+    void setMaxIdle( int maxIdle ) { maxIdle_ = maxIdle; }
+
+    //*** counters ***
+    ConnectionPoolStats stats() const { return stats_; }
+
+    //*** wraps an accepted descriptor, nullptr on failure ***
+    QTcpSocket *acquire( qintptr descriptor, ConnectionHandler *handler );
+
+    //*** empties the arenas after a response has been written ***
+    void requestDone( PooledConnection *conn );
+
+    //*** aborts every connection served by a handler that is going away ***
+    void detach( ConnectionHandler *handler );
+
+
+private slots:
+
+    //*** socket signals, connected once per object ***
+    void socketReadyRead();
+    void socketError( QAbstractSocket::SocketError socketError );
+    void socketDisconnected();
+
+
+private:
+
+    Q_DISABLE_COPY( ConnectionPool )
+
+    //*** returns a connection to the idle list ***
+    void recycle( PooledConnection *conn );
+
+    //*** every connection object by socket ***
+    QHash<QObject*,PooledConnection*> conns_;
+
+    //*** ready for reuse ***
+    QList<PooledConnection*> idle_;
+
+    int maxIdle_;
+
+    ConnectionPoolStats stats_;
+};
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief The PooledTcpServer class - QTcpServer that takes its client sockets
+ *        from a ConnectionPool
+ */
+//*****************************************************************************
+class PooledTcpServer : public QTcpServer
+{
+    Q_OBJECT
+
+public:
+
+    //*** constructor ***
+    PooledTcpServer( ConnectionPool *pool, ConnectionHandler *handler, QObject *parent = nullptr );
+
+
+protected:
+
+    //*** new descriptor from the listening socket ***
+    void incomingConnection( qintptr descriptor ) override;
+
+
+private:
+
+    ConnectionPool    *pool_;
+    ConnectionHandler *handler_;
+};
+
+#endif // CONNECTIONPOOL_H
@@ -0,0 +1,23 @@
+# Library, tools and tests - build this one, or FauxMoLib.pro for the
+# library alone
+TEMPLATE = subdirs
+
+SUBDIRS += \
+    lib \
+    bench \
+    replay \
+    soak \
+    tests
+
+lib.file = FauxMoLib.pro
+
+bench.depends = lib
+replay.depends = lib
+soak.depends = lib
+tests.depends = lib
+
+# libFuzzer target, clang only - qmake CONFIG+=fauxmo_fuzz
+fauxmo_fuzz {
+    SUBDIRS += fuzz
+    fuzz.depends = lib
+}
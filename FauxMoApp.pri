@@ -0,0 +1,26 @@
+# Common settings for the programs built against the library (bench, tools,
+# tests) - include from their .pro files
+
+QT -= gui
+
+QT += network
+
+CONFIG += c++11 console
+CONFIG -= app_bundle
+
+DEFINES += QT_DEPRECATED_WARNINGS
+
+INCLUDEPATH += $$PWD
+DEPENDPATH += $$PWD
+
+# where FauxMoLib.pro is built
+FAUXMO_LIB_DIR = $$shadowed($$PWD)
+
+win32:CONFIG(release, debug|release): LIBS += -L$$FAUXMO_LIB_DIR/release/ -lFauxMoLib
+else:win32:CONFIG(debug, debug|release): LIBS += -L$$FAUXMO_LIB_DIR/debug/ -lFauxMoLib
+else:unix: LIBS += -L$$FAUXMO_LIB_DIR/ -lFauxMoLib
+
+# run from the build tree without installing the library
+unix:!macx: QMAKE_RPATHDIR += $$FAUXMO_LIB_DIR
+
+unix:!macx: LIBS += -lrt
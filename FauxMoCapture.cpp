@@ -0,0 +1,116 @@
+#include "FauxMoCapture.h"
+#include "FauxMoLog.h"
+
+#include <QFile>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QElapsedTimer>
+#include <QDateTime>
+
+#include <cstring>
+
+std::atomic<bool> FauxMoCapture::enabled_( false );
+
+//*** open capture file - records from all threads go through one lock ***
+static QMutex captureLock;
+static QFile *captureFile = nullptr;
+static QElapsedTimer captureClock;
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief FauxMoCapture::start - replaces a capture in progress
+ * @param fileName
+ * @return
+ */
+//*****************************************************************************
+bool FauxMoCapture::start( const QString &fileName )
+{
+    stop();
+
+    QMutexLocker lock( &captureLock );
+
+    QFile *file = new QFile( fileName );
+    if ( !file->open( QIODevice::WriteOnly | QIODevice::Truncate ) )
+    {
+        FAUXMO_LOG( General, Error, "", "Can't open capture file %s", qPrintable( fileName ) );
+        delete file;
+        return false;
+    }
+
+    FauxMoCaptureHeader hdr;
+    memset( &hdr, 0, sizeof(hdr) );
+    hdr.magic   = FAUXMO_CAPTURE_MAGIC;
+    hdr.version = FAUXMO_CAPTURE_VERSION;
+    hdr.startMs = QDateTime::currentMSecsSinceEpoch();
+
+    file->write( reinterpret_cast<const char*>(&hdr), sizeof(hdr) );
+
+    captureFile = file;
+    captureClock.start();
+    enabled_.store( true );
+
+    FAUXMO_LOG( General, Info, "", "Capturing traffic to %s", qPrintable( fileName ) );
+
+    return true;
+}
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief FauxMoCapture::stop
+ */
+//*****************************************************************************
+void FauxMoCapture::stop()
+{
+    QMutexLocker lock( &captureLock );
+
+    enabled_.store( false );
+
+    if ( !captureFile ) return;
+
+    captureFile->close();
+    delete captureFile;
+    captureFile = nullptr;
+}
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief FauxMoCapture::record - QFile buffers, so a record is usually just
+ *        two copies under the lock
+ * @param kind
+ * @param peerIp - IPv4 sender, host byte order
+ * @param peerPort
+ * @param localPort - port it arrived on
+ * @param data
+ * @param len
+ */
+//*****************************************************************************
+void FauxMoCapture::record( Kind kind, quint32 peerIp, quint16 peerPort, quint16 localPort,
+                            const char *data, int len )
+{
+FauxMoCaptureRecord rec;
+
+    if ( len <= 0 ) return;
+
+    memset( &rec, 0, sizeof(rec) );
+    rec.peerIp    = peerIp;
+    rec.length    = quint32(len);
+    rec.peerPort  = peerPort;
+    rec.localPort = localPort;
+    rec.kind      = quint8(kind);
+
+    QMutexLocker lock( &captureLock );
+
+    //*** stopped while we were getting here ***
+    if ( !captureFile ) return;
+
+    rec.timeUs = quint64( captureClock.nsecsElapsed() / 1000 );
+
+    captureFile->write( reinterpret_cast<const char*>(&rec), sizeof(rec) );
+    captureFile->write( data, len );
+}
@@ -0,0 +1,82 @@
+#ifndef FAUXMOCAPTURE_H
+#define FAUXMOCAPTURE_H
+
+#include "FauxMoLib_global.h"
+
+#include <QString>
+
+#include <atomic>
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * Traffic capture file written by FauxMoCapture and played back by
+ * FauxMoReplay. Host byte order, no padding between records.
+ *
+ *   [FauxMoCaptureHeader][FauxMoCaptureRecord][data x length] ...
+ *
+ * SSDP records hold one inbound datagram, HTTP records one complete device
+ * request as framed by the connection limits.
+ */
+//*****************************************************************************
+
+#define FAUXMO_CAPTURE_MAGIC    0x50435846u     // "FXCP"
+#define FAUXMO_CAPTURE_VERSION  1u
+
+struct FauxMoCaptureHeader
+{
+    quint32 magic;
+    quint32 version;
+    qint64  startMs;        // ms since epoch when the capture started
+};
+
+struct FauxMoCaptureRecord
+{
+    quint64 timeUs;         // since the capture started
+    quint32 peerIp;         // IPv4 sender
+    quint32 length;         // bytes of data following
+    quint16 peerPort;
+    quint16 localPort;      // 1900, device or Hue bridge port
+    quint8  kind;           // FauxMoCapture::Kind
+    quint8  pad[3];
+};
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief The FauxMoCapture class - records inbound discovery datagrams and
+ *        device requests, from any thread
+ */
+//*****************************************************************************
+class FAUXMOLIB_EXPORT FauxMoCapture
+{
+public:
+
+    //*** what a record holds ***
+    enum Kind
+    {
+        Ssdp = 1,
+        Http
+    };
+
+    //*** the one branch taken when capture is off ***
+    static bool enabled() { return enabled_.load( std::memory_order_relaxed ); }
+
+    //*** starts writing a new file ***
+    static bool start( const QString &fileName );
+
+    //*** flushes and closes the file ***
+    static void stop();
+
+    //*** appends a record - peerIp is IPv4 in host byte order ***
+    static void record( Kind kind, quint32 peerIp, quint16 peerPort, quint16 localPort,
+                        const char *data, int len );
+
+
+private:
+
+    static std::atomic<bool> enabled_;
+};
+
+#endif // FAUXMOCAPTURE_H
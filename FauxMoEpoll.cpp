@@ -0,0 +1,1448 @@
+#include "FauxMoEpoll.h"
+#include "ConnectionPool.h"
+#include "FauxMoLog.h"
+#include "FauxMoTrace.h"
+#include "FauxMoCapture.h"
+
+#include <QThread>
+#include <QElapsedTimer>
+#include <QMutexLocker>
+
+#if defined(Q_OS_LINUX)
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+
+//*** Linux 4.5, older headers lack it ***
+#ifndef EPOLLEXCLUSIVE
+#define EPOLLEXCLUSIVE (1u << 28)
+#endif
+#endif
+
+//*** epoll_wait timeout - also how often deadlines are checked ***
+const int EPOLL_TICK_MS         = 100;
+const int EPOLL_MAX_EVENTS      = 256;
+const int EPOLL_LISTEN_BACKLOG  = 128;
+
+//*** read chunk for device connections ***
+const int EPOLL_READ_CHUNK      = 4096;
+
+//*** how long removeDevice waits for the loops to stop watching a port ***
+const int EPOLL_REMOVE_WAIT_MS  = 2000;
+
+
+#if defined(Q_OS_LINUX)
+
+//*** what a registration is, kept in the high word of epoll_event.data.u64 ***
+enum EpollKind
+{
+    KindWake = 1,
+    KindUdp,
+    KindListen,
+    KindConn
+};
+
+static quint64 epollTag( EpollKind kind, int fd )
+{
+    return ( quint64(kind) << 32 ) | quint32(fd);
+}
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief The EpollConn struct - one device connection, recycled per loop
+ */
+//*****************************************************************************
+struct EpollConn
+{
+    int            fd;
+    EpollDevicePtr dev;
+
+    //*** arenas - capacity is kept between connections ***
+    QByteArray     in;
+    QByteArray     out;
+    int            outPos;
+
+    bool           responded;
+    bool           peerClosed;
+
+    qint64         acceptedMs;
+    qint64         lastActivityMs;
+};
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief The EpollCommand struct - device table change posted to a loop
+ */
+//*****************************************************************************
+struct EpollCommand
+{
+    enum Op { Add, Remove };
+
+    Op             op;
+    EpollDevicePtr dev;
+
+    //*** released once the loop has applied it, may be null ***
+    QSharedPointer<QSemaphore> done;
+};
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief openListener - non-blocking listening socket on every address.
+ *        SO_REUSEADDR only, so a port another socket listens on fails here.
+ * @param port
+ * @return - fd, -1 with errno set on failure
+ */
+//*****************************************************************************
+static int openListener( quint16 port )
+{
+int one = 1;
+
+    int fd = socket( AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0 );
+    if ( fd < 0 ) return -1;
+
+    setsockopt( fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one) );
+
+    struct sockaddr_in addr;
+    memset( &addr, 0, sizeof(addr) );
+    addr.sin_family      = AF_INET;
+    addr.sin_port        = htons( port );
+    addr.sin_addr.s_addr = htonl( INADDR_ANY );
+
+    if ( bind( fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr) ) < 0 ||
+         listen( fd, EPOLL_LISTEN_BACKLOG ) < 0 )
+    {
+        int err = errno;
+        ::close( fd );
+        errno = err;
+        return -1;
+    }
+
+    return fd;
+}
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief The EpollLoop class - one epoll instance and the thread running it
+ */
+//*****************************************************************************
+class EpollLoop : public QThread
+{
+public:
+
+    EpollLoop( FauxMoEpoll *owner, int index );
+    ~EpollLoop();
+
+    //*** creates the epoll instance, wake fd and (loop 0) the SSDP socket ***
+    bool open( const QList<EpollInterface> &interfaces, quint32 group, quint16 port );
+
+    void requestStop();
+
+    //*** multicast on every interface from the SSDP socket (loop 0), safe
+    //*** from any thread - the loop only sends unicast on it ***
+    void sendMulticast( const QByteArray &msg );
+
+    //*** queues a device change, safe from any thread ***
+    void post( EpollCommand::Op op, EpollDevicePtr dev, QSharedPointer<QSemaphore> done = QSharedPointer<QSemaphore>() );
+
+    //*** counters, written by the loop thread only ***
+    std::atomic<quint64> accepted;
+    std::atomic<quint64> rejectedGlobalLimit;
+    std::atomic<quint64> rejectedDeviceLimit;
+    std::atomic<quint64> rejectedHeaderTooLarge;
+    std::atomic<quint64> rejectedBodyTooLarge;
+    std::atomic<quint64> idleTimeouts;
+    std::atomic<quint64> requestTimeouts;
+
+protected:
+
+    void run() override;
+
+private:
+
+    void wake();
+    void processCommands();
+
+    //*** device ports ***
+    void addListener( EpollDevicePtr dev );
+    void removeListener( EpollDevice *dev );
+    void acceptAll( int listenFd );
+
+    //*** device connections ***
+    void readConn( EpollConn *c );
+    void handleRequest( EpollConn *c, int size );
+    void writeConn( EpollConn *c );
+    void closeConn( EpollConn *c );
+    void checkDeadlines();
+
+    //*** discovery ***
+    void readDatagrams();
+    void sendSearchResponse( const sockaddr_in &to, quint32 local, const EpollDevicePtr &dev, SsdpTarget target );
+    quint32 localAddressFor( int ifIndex, quint32 sender ) const;
+
+    FauxMoEpoll *owner_;
+    int index_;
+
+    int epfd_;
+    int wakeFd_;
+    int udpFd_;
+    quint16 udpPort_;
+    quint32 group_;
+
+    std::atomic<bool> stop_;
+
+    //*** pending device changes ***
+    QMutex cmdLock_;
+    QList<EpollCommand> cmds_;
+
+    //*** device ports watched by this loop ***
+    QHash<int,EpollDevicePtr> listeners_;
+    QHash<EpollDevice*,int> listenFds_;
+
+    //*** open connections by fd, spare ones for reuse ***
+    QHash<int,EpollConn*> conns_;
+    QList<EpollConn*> spare_;
+
+    //*** discovery - interfaces, responses by local address and device ***
+    QList<EpollInterface> interfaces_;
+    QHash< quint32, QHash< EpollDevice*, QVector<QByteArray> > > responseCache_;
+    QByteArray responseHead_;
+    QByteArray udpOut_;
+
+    QElapsedTimer clock_;
+};
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief EpollLoop::EpollLoop
+ * @param owner
+ * @param index - loop 0 also answers discovery
+ */
+//*****************************************************************************
+EpollLoop::EpollLoop( FauxMoEpoll *owner, int index )
+    : accepted(0),
+      rejectedGlobalLimit(0),
+      rejectedDeviceLimit(0),
+      rejectedHeaderTooLarge(0),
+      rejectedBodyTooLarge(0),
+      idleTimeouts(0),
+      requestTimeouts(0),
+      owner_(owner),
+      index_(index),
+      epfd_(-1),
+      wakeFd_(-1),
+      udpFd_(-1),
+      udpPort_(0),
+      group_(0),
+      stop_(false)
+{
+    udpOut_.reserve( 1024 );
+}
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief EpollLoop::~EpollLoop - the thread has finished by now
+ */
+//*****************************************************************************
+EpollLoop::~EpollLoop()
+{
+    foreach( auto conn, conns_ )
+    {
+        ::close( conn->fd );
+        conn->dev->connections--;
+        owner_->connections_--;
+        delete conn;
+    }
+
+    qDeleteAll( spare_ );
+
+    //*** listening sockets belong to the devices ***
+    if ( udpFd_ >= 0 ) ::close( udpFd_ );
+    if ( wakeFd_ >= 0 ) ::close( wakeFd_ );
+    if ( epfd_ >= 0 ) ::close( epfd_ );
+}
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief EpollLoop::open
+ * @param interfaces - addresses to answer discovery on
+ * @param group - SSDP multicast group, host order
+ * @param port - SSDP port
+ * @return
+ */
+//*****************************************************************************
+bool EpollLoop::open( const QList<EpollInterface> &interfaces, quint32 group, quint16 port )
+{
+struct epoll_event ev;
+int one = 1;
+
+    interfaces_ = interfaces;
+
+    epfd_   = epoll_create1( EPOLL_CLOEXEC );
+    wakeFd_ = eventfd( 0, EFD_NONBLOCK | EFD_CLOEXEC );
+
+    if ( epfd_ < 0 || wakeFd_ < 0 )
+    {
+        FAUXMO_LOG( General, Error, "", "epoll loop %d: can't create epoll/eventfd: %s", index_, strerror( errno ) );
+        return false;
+    }
+
+    memset( &ev, 0, sizeof(ev) );
+    ev.events   = EPOLLIN | EPOLLET;
+    ev.data.u64 = epollTag( KindWake, wakeFd_ );
+    epoll_ctl( epfd_, EPOLL_CTL_ADD, wakeFd_, &ev );
+
+    //*** multicast goes to every socket bound to the port - one loop answers ***
+    if ( index_ != 0 ) return true;
+
+    udpFd_ = socket( AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0 );
+    if ( udpFd_ < 0 ) return false;
+
+    udpPort_ = port;
+    group_   = group;
+
+    //*** same sharing as the Qt engine's ShareAddress ***
+    setsockopt( udpFd_, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one) );
+
+    //*** tells us which interface a search came in on ***
+    setsockopt( udpFd_, IPPROTO_IP, IP_PKTINFO, &one, sizeof(one) );
+
+    struct sockaddr_in addr;
+    memset( &addr, 0, sizeof(addr) );
+    addr.sin_family      = AF_INET;
+    addr.sin_port        = htons( port );
+    addr.sin_addr.s_addr = htonl( INADDR_ANY );
+
+    if ( bind( udpFd_, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr) ) < 0 )
+    {
+        FAUXMO_LOG( Discovery, Error, "UDP", "epoll: bind to port %u failed: %s", unsigned(port), strerror( errno ) );
+        return false;
+    }
+
+    //*** join the group on every interface ***
+    QList<int> joined;
+    foreach( auto sif, interfaces_ )
+    {
+        if ( joined.contains( sif.ifIndex ) ) continue;
+        joined.append( sif.ifIndex );
+
+        struct ip_mreqn mreq;
+        memset( &mreq, 0, sizeof(mreq) );
+        mreq.imr_multiaddr.s_addr = htonl( group );
+        mreq.imr_ifindex          = sif.ifIndex;
+
+        if ( setsockopt( udpFd_, IPPROTO_IP, IP_ADD_MEMBERSHIP, &mreq, sizeof(mreq) ) < 0 )
+            FAUXMO_LOG( Discovery, Warning, "UDP", "epoll: can't join multicast group on interface %d", sif.ifIndex );
+    }
+
+    memset( &ev, 0, sizeof(ev) );
+    ev.events   = EPOLLIN | EPOLLET;
+    ev.data.u64 = epollTag( KindUdp, udpFd_ );
+    epoll_ctl( epfd_, EPOLL_CTL_ADD, udpFd_, &ev );
+
+    return true;
+}
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief EpollLoop::requestStop
+ */
+//*****************************************************************************
+void EpollLoop::requestStop()
+{
+    stop_.store( true );
+    wake();
+}
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief EpollLoop::post
+ * @param op
+ * @param dev
+ * @param done - released once applied
+ */
+//*****************************************************************************
+void EpollLoop::post( EpollCommand::Op op, EpollDevicePtr dev, QSharedPointer<QSemaphore> done )
+{
+    EpollCommand cmd;
+    cmd.op   = op;
+    cmd.dev  = dev;
+    cmd.done = done;
+
+    {
+        QMutexLocker lock( &cmdLock_ );
+        cmds_.append( cmd );
+    }
+
+    wake();
+}
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief EpollLoop::sendMulticast - outgoing interface is set per datagram
+ *        (IP_PKTINFO), so the socket's options are never changed
+ * @param msg
+ */
+//*****************************************************************************
+void EpollLoop::sendMulticast( const QByteArray &msg )
+{
+char control[CMSG_SPACE(sizeof(struct in_pktinfo))];
+QList<int> sent;
+
+    if ( udpFd_ < 0 ) return;
+
+    struct sockaddr_in to;
+    memset( &to, 0, sizeof(to) );
+    to.sin_family      = AF_INET;
+    to.sin_port        = htons( udpPort_ );
+    to.sin_addr.s_addr = htonl( group_ );
+
+    foreach( auto sif, interfaces_ )
+    {
+        if ( sent.contains( sif.ifIndex ) ) continue;
+        sent.append( sif.ifIndex );
+
+        struct iovec iov;
+        iov.iov_base = const_cast<char*>( msg.constData() );
+        iov.iov_len  = size_t( msg.size() );
+
+        struct msghdr hdr;
+        memset( &hdr, 0, sizeof(hdr) );
+        memset( control, 0, sizeof(control) );
+        hdr.msg_name       = &to;
+        hdr.msg_namelen    = sizeof(to);
+        hdr.msg_iov        = &iov;
+        hdr.msg_iovlen     = 1;
+        hdr.msg_control    = control;
+        hdr.msg_controllen = sizeof(control);
+
+        struct cmsghdr *cmsg = CMSG_FIRSTHDR( &hdr );
+        cmsg->cmsg_level = IPPROTO_IP;
+        cmsg->cmsg_type  = IP_PKTINFO;
+        cmsg->cmsg_len   = CMSG_LEN( sizeof(struct in_pktinfo) );
+        reinterpret_cast<struct in_pktinfo*>( CMSG_DATA(cmsg) )->ipi_ifindex = sif.ifIndex;
+
+        //*** best effort, like the Qt engine's byebye ***
+        sendmsg( udpFd_, &hdr, 0 );
+    }
+}
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief EpollLoop::wake
+ */
+//*****************************************************************************
+void EpollLoop::wake()
+{
+    quint64 one = 1;
+
+    if ( ::write( wakeFd_, &one, sizeof(one) ) < 0 ) { /* counter full - already awake */ }
+}
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief EpollLoop::run
+ */
+//*****************************************************************************
+void EpollLoop::run()
+{
+struct epoll_event events[EPOLL_MAX_EVENTS];
+
+    FauxMoLogScope logScope( owner_->logOwner_ );
+
+    clock_.start();
+    qint64 nextCheck = EPOLL_TICK_MS;
+
+    processCommands();
+
+    while ( !stop_.load() )
+    {
+        int n = epoll_wait( epfd_, events, EPOLL_MAX_EVENTS, EPOLL_TICK_MS );
+        if ( n < 0 )
+        {
+            if ( errno == EINTR ) continue;
+
+            FAUXMO_LOG( General, Error, "", "epoll loop %d: epoll_wait failed: %s", index_, strerror( errno ) );
+            break;
+        }
+
+        for ( int i = 0; i < n; i++ )
+        {
+            EpollKind kind = EpollKind( events[i].data.u64 >> 32 );
+            int fd         = int( quint32( events[i].data.u64 ) );
+
+            switch ( kind )
+            {
+            case KindWake:
+            {
+                quint64 count;
+                while ( ::read( wakeFd_, &count, sizeof(count) ) > 0 ) {}
+                processCommands();
+                break;
+            }
+
+            case KindUdp:
+                readDatagrams();
+                break;
+
+            case KindListen:
+                acceptAll( fd );
+                break;
+
+            case KindConn:
+            {
+                EpollConn *c = conns_.value( fd );
+                if ( !c ) break;
+
+                if ( events[i].events & ( EPOLLERR | EPOLLHUP ) )
+                {
+                    closeConn( c );
+                    break;
+                }
+
+                if ( events[i].events & ( EPOLLIN | EPOLLRDHUP ) )
+                {
+                    readConn( c );
+                    if ( !conns_.contains( fd ) ) break;
+                }
+
+                if ( ( events[i].events & EPOLLOUT ) && c->responded ) writeConn( c );
+                break;
+            }
+            }
+        }
+
+        if ( clock_.elapsed() >= nextCheck )
+        {
+            checkDeadlines();
+            nextCheck = clock_.elapsed() + EPOLL_TICK_MS;
+        }
+    }
+}
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief EpollLoop::processCommands
+ */
+//*****************************************************************************
+void EpollLoop::processCommands()
+{
+QList<EpollCommand> cmds;
+
+    {
+        QMutexLocker lock( &cmdLock_ );
+        cmds.swap( cmds_ );
+    }
+
+    foreach( auto cmd, cmds )
+    {
+        if ( cmd.op == EpollCommand::Add )
+            addListener( cmd.dev );
+        else
+            removeListener( cmd.dev.data() );
+
+        if ( cmd.done ) cmd.done->release();
+    }
+}
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief EpollLoop::addListener - watches the device's listening socket.
+ *        Level triggered and exclusive: all loops watch it, one waiting
+ *        loop is woken per connection.
+ * @param dev
+ */
+//*****************************************************************************
+void EpollLoop::addListener( EpollDevicePtr dev )
+{
+    if ( listenFds_.contains( dev.data() ) ) return;
+
+    int fd = dev->listenFd;
+
+    struct epoll_event ev;
+    memset( &ev, 0, sizeof(ev) );
+    ev.events   = EPOLLIN | EPOLLEXCLUSIVE;
+    ev.data.u64 = epollTag( KindListen, fd );
+
+    if ( epoll_ctl( epfd_, EPOLL_CTL_ADD, fd, &ev ) < 0 )
+    {
+        FAUXMO_LOG( General, Error, "", "epoll loop %d: can't watch TCP port %u: %s",
+                    index_, unsigned(dev->port), strerror( errno ) );
+        return;
+    }
+
+    listeners_.insert( fd, dev );
+    listenFds_.insert( dev.data(), fd );
+}
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief EpollLoop::removeListener - stops watching the port, FauxMoEpoll
+ *        closes it once every loop has. Open connections finish normally.
+ * @param dev
+ */
+//*****************************************************************************
+void EpollLoop::removeListener( EpollDevice *dev )
+{
+    for ( auto it = responseCache_.begin(); it != responseCache_.end(); ++it )
+        it.value().remove( dev );
+
+    if ( !listenFds_.contains( dev ) ) return;
+
+    int fd = listenFds_.take( dev );
+    listeners_.remove( fd );
+
+    epoll_ctl( epfd_, EPOLL_CTL_DEL, fd, nullptr );
+}
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief EpollLoop::acceptAll - edge triggered, accept until EAGAIN
+ * @param listenFd
+ */
+//*****************************************************************************
+void EpollLoop::acceptAll( int listenFd )
+{
+    EpollDevicePtr dev = listeners_.value( listenFd );
+    if ( !dev ) return;
+
+    const ConnectionLimits &limits = owner_->limits_;
+
+    for (;;)
+    {
+        int fd = accept4( listenFd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC );
+        if ( fd < 0 )
+        {
+            if ( errno == EINTR || errno == ECONNABORTED ) continue;
+            break;
+        }
+
+        FAUXMO_TRACE( trace, TcpAccept, fd );
+
+        //*** same caps as ConnectionGuard - reserve first, other loops
+        //*** accept at the same time ***
+        if ( owner_->connections_.fetch_add( 1 ) >= limits.maxConnections )
+        {
+            owner_->connections_--;
+            rejectedGlobalLimit++;
+            ::close( fd );
+            continue;
+        }
+
+        if ( dev->connections.fetch_add( 1 ) >= limits.maxConnectionsPerDevice )
+        {
+            dev->connections--;
+            owner_->connections_--;
+            rejectedDeviceLimit++;
+            ::close( fd );
+            continue;
+        }
+
+        accepted++;
+
+        EpollConn *c;
+        if ( !spare_.isEmpty() )
+        {
+            c = spare_.takeLast();
+        }
+        else
+        {
+            c = new EpollConn;
+            c->in.reserve( POOL_REQUEST_ARENA );
+            c->out.reserve( POOL_RESPONSE_ARENA );
+        }
+
+        c->fd             = fd;
+        c->dev            = dev;
+        c->outPos         = 0;
+        c->responded      = false;
+        c->peerClosed     = false;
+        c->acceptedMs     = clock_.elapsed();
+        c->lastActivityMs = c->acceptedMs;
+
+        conns_.insert( fd, c );
+
+        //*** adding reports data that is already waiting ***
+        struct epoll_event ev;
+        memset( &ev, 0, sizeof(ev) );
+        ev.events   = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+        ev.data.u64 = epollTag( KindConn, fd );
+        epoll_ctl( epfd_, EPOLL_CTL_ADD, fd, &ev );
+    }
+}
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief EpollLoop::readConn - edge triggered, read until EAGAIN, then frame
+ *        like ConnectionGuard::readRequest
+ * @param c
+ */
+//*****************************************************************************
+void EpollLoop::readConn( EpollConn *c )
+{
+char buf[EPOLL_READ_CHUNK];
+
+    FAUXMO_TRACE( trace, TcpData, c->fd );
+
+    const ConnectionLimits &limits = owner_->limits_;
+    const int maxRequest = limits.maxHeaderBytes + 4 + limits.maxBodyBytes;
+
+    for (;;)
+    {
+        ssize_t got = ::read( c->fd, buf, sizeof(buf) );
+
+        if ( got > 0 )
+        {
+            //*** nothing more is expected once we've answered ***
+            if ( !c->responded ) c->in.append( buf, int(got) );
+            c->lastActivityMs = clock_.elapsed();
+
+            if ( c->in.size() > maxRequest ) break;
+            continue;
+        }
+
+        if ( got == 0 )
+        {
+            c->peerClosed = true;
+            break;
+        }
+
+        if ( errno == EINTR ) continue;
+        if ( errno == EAGAIN || errno == EWOULDBLOCK ) break;
+
+        closeConn( c );
+        return;
+    }
+
+    if ( !c->responded )
+    {
+        //*** look for end of headers ***
+        int hdrEnd = FauxMoProtocol::find( c->in.constData(), c->in.size(), "\r\n\r\n" );
+
+        if ( ( hdrEnd < 0 && c->in.size() > limits.maxHeaderBytes ) || hdrEnd > limits.maxHeaderBytes )
+        {
+            rejectedHeaderTooLarge++;
+            closeConn( c );
+            return;
+        }
+
+        if ( hdrEnd >= 0 )
+        {
+            qint64 bodyLen = FauxMoProtocol::contentLength( c->in.constData(), hdrEnd );
+            if ( bodyLen > limits.maxBodyBytes )
+            {
+                rejectedBodyTooLarge++;
+                closeConn( c );
+                return;
+            }
+
+            int total = hdrEnd + 4 + int(bodyLen);
+            if ( c->in.size() >= total )
+            {
+                handleRequest( c, total );
+                return;
+            }
+        }
+    }
+
+    //*** gone before a full request ***
+    if ( c->peerClosed ) closeConn( c );
+}
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief EpollLoop::handleRequest - protocol core renders into the out arena
+ * @param c
+ * @param size - bytes of the request at the start of the in arena
+ */
+//*****************************************************************************
+void EpollLoop::handleRequest( EpollConn *c, int size )
+{
+WemoProtocol::Result result;
+QString name;
+bool state = false;
+
+    //*** traffic capture for replay - peer is only looked up when capturing ***
+    if ( FauxMoCapture::enabled() )
+    {
+        struct sockaddr_in peer;
+        socklen_t peerLen = sizeof(peer);
+        memset( &peer, 0, sizeof(peer) );
+        getpeername( c->fd, reinterpret_cast<struct sockaddr*>(&peer), &peerLen );
+
+        FauxMoCapture::record( FauxMoCapture::Http, ntohl( peer.sin_addr.s_addr ),
+                               ntohs( peer.sin_port ), c->dev->port, c->in.constData(), size );
+    }
+
+    {
+        FAUXMO_TRACE( trace, Handler, c->fd );
+        QMutexLocker lock( &c->dev->lock );
+
+        result = c->dev->protocol.handleRequest( c->in.constData(), size, c->out );
+
+        if ( result == WemoProtocol::StateSet )
+        {
+            name  = c->dev->protocol.name();
+            state = c->dev->protocol.state();
+        }
+    }
+
+    c->in.resize( 0 );
+
+    if ( result == WemoProtocol::StateSet )
+    {
+        //*** polls on the members must see the new state once we've answered ***
+        owner_->switchMembers( name, state );
+
+        //*** delivered to the FauxMoQt thread ***
+        emit owner_->deviceStateSet( name, state );
+    }
+
+    //*** if no response, leave the connection to the deadlines ***
+    if ( result == WemoProtocol::NoResponse )
+    {
+        if ( c->peerClosed ) closeConn( c );
+        return;
+    }
+
+    c->responded = true;
+    c->outPos    = 0;
+
+    writeConn( c );
+}
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief EpollLoop::writeConn - closes once everything is sent ('CONNECTION:
+ *        close'), EPOLLOUT brings us back if the socket buffer is full
+ * @param c
+ */
+//*****************************************************************************
+void EpollLoop::writeConn( EpollConn *c )
+{
+    FAUXMO_TRACE( trace, TcpWrite, c->fd );
+
+    while ( c->outPos < c->out.size() )
+    {
+        ssize_t sent = ::send( c->fd, c->out.constData() + c->outPos, size_t( c->out.size() - c->outPos ), MSG_NOSIGNAL );
+
+        if ( sent > 0 )
+        {
+            c->outPos += int(sent);
+            continue;
+        }
+
+        if ( sent < 0 && errno == EINTR ) continue;
+        if ( sent < 0 && ( errno == EAGAIN || errno == EWOULDBLOCK ) ) return;
+
+        break;
+    }
+
+    closeConn( c );
+}
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief EpollLoop::closeConn - the object goes back on the spare list
+ * @param c
+ */
+//*****************************************************************************
+void EpollLoop::closeConn( EpollConn *c )
+{
+    conns_.remove( c->fd );
+
+    //*** close also removes it from the epoll set ***
+    ::close( c->fd );
+
+    c->dev->connections--;
+    owner_->connections_--;
+
+    c->fd = -1;
+    c->dev.clear();
+    c->in.resize( 0 );
+    c->out.resize( 0 );
+
+    if ( spare_.size() < POOL_DEFAULT_MAX_IDLE )
+        spare_.append( c );
+    else
+        delete c;
+}
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief EpollLoop::checkDeadlines - same idle/request timeouts as
+ *        ConnectionGuard
+ */
+//*****************************************************************************
+void EpollLoop::checkDeadlines()
+{
+    if ( conns_.isEmpty() ) return;
+
+    const ConnectionLimits &limits = owner_->limits_;
+    qint64 now = clock_.elapsed();
+
+    foreach( auto c, conns_.values() )
+    {
+        if ( now >= c->acceptedMs + limits.requestTimeoutMs )
+        {
+            requestTimeouts++;
+            closeConn( c );
+        }
+        else if ( now >= c->lastActivityMs + limits.idleTimeoutMs )
+        {
+            idleTimeouts++;
+            closeConn( c );
+        }
+    }
+}
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief EpollLoop::readDatagrams - answers searches for every device with
+ *        the address of the interface the search came in on
+ */
+//*****************************************************************************
+void EpollLoop::readDatagrams()
+{
+char buf[2048];
+char control[CMSG_SPACE(sizeof(struct in_pktinfo))];
+
+    for (;;)
+    {
+        struct sockaddr_in from;
+        struct iovec iov;
+        struct msghdr msg;
+
+        iov.iov_base = buf;
+        iov.iov_len  = sizeof(buf);
+
+        memset( &msg, 0, sizeof(msg) );
+        msg.msg_name       = &from;
+        msg.msg_namelen    = sizeof(from);
+        msg.msg_iov        = &iov;
+        msg.msg_iovlen     = 1;
+        msg.msg_control    = control;
+        msg.msg_controllen = sizeof(control);
+
+        ssize_t n = recvmsg( udpFd_, &msg, 0 );
+        if ( n < 0 )
+        {
+            if ( errno == EINTR ) continue;
+            break;
+        }
+
+        if ( !owner_->discoveryEnabled() ) continue;
+
+        //*** interface it arrived on ***
+        int ifIndex = 0;
+        for ( struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg) )
+        {
+            if ( cmsg->cmsg_level == IPPROTO_IP && cmsg->cmsg_type == IP_PKTINFO )
+                ifIndex = reinterpret_cast<struct in_pktinfo*>( CMSG_DATA(cmsg) )->ipi_ifindex;
+        }
+
+        quint32 sender     = ntohl( from.sin_addr.s_addr );
+        quint16 senderPort = ntohs( from.sin_port );
+
+        FAUXMO_TRACE( trace, SsdpReceive, ( quint64(sender) << 16 ) | senderPort );
+
+        //*** traffic capture for replay ***
+        if ( FauxMoCapture::enabled() )
+            FauxMoCapture::record( FauxMoCapture::Ssdp, sender, senderPort, udpPort_, buf, int(n) );
+
+        //*** the Hue bridge needs the Qt engine ***
+        SsdpTarget target = FauxMoProtocol::classifySearch( buf, int(n) );
+        if ( target == SsdpNone || target == SsdpHue ) continue;
+
+        quint32 local = localAddressFor( ifIndex, sender );
+        if ( !local ) continue;
+
+        foreach( auto dev, listeners_ )
+            sendSearchResponse( from, local, dev, target );
+    }
+}
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief EpollLoop::sendSearchResponse - pre-rendered per local address and
+ *        device, only the date is filled in per send
+ * @param to
+ * @param local
+ * @param dev
+ * @param target
+ */
+//*****************************************************************************
+void EpollLoop::sendSearchResponse( const sockaddr_in &to, quint32 local, const EpollDevicePtr &dev, SsdpTarget target )
+{
+    FAUXMO_TRACE( trace, SsdpResponse, ( quint64(ntohl(to.sin_addr.s_addr)) << 16 ) | ntohs(to.sin_port) );
+
+    QVector<QByteArray> &tails = responseCache_[local][dev.data()];
+    if ( tails.isEmpty() )
+    {
+        QString uuid;
+        {
+            QMutexLocker lock( &dev->lock );
+            uuid = dev->protocol.uuid();
+        }
+
+        QString location = QHostAddress( local ).toString() + ":" + QString::number( dev->port );
+        FauxMoProtocol::renderSearchResponses( location, uuid, responseHead_, tails );
+    }
+
+    FauxMoProtocol::assembleSearchResponse( udpOut_, responseHead_, tails.at( target ) );
+
+    //*** best effort, like any SSDP response ***
+    sendto( udpFd_, udpOut_.constData(), size_t(udpOut_.size()), 0,
+            reinterpret_cast<const struct sockaddr*>(&to), sizeof(to) );
+}
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief EpollLoop::localAddressFor - same choice as FauxMoQt::localAddressFor
+ * @param ifIndex - 0 if unknown
+ * @param sender
+ * @return - 0 if the interface is not one of ours
+ */
+//*****************************************************************************
+quint32 EpollLoop::localAddressFor( int ifIndex, quint32 sender ) const
+{
+quint32 first = 0;
+
+    foreach( auto sif, interfaces_ )
+    {
+        if ( ifIndex && sif.ifIndex != ifIndex ) continue;
+
+        if ( ( sender & sif.netmask ) == ( sif.ip & sif.netmask ) ) return sif.ip;
+
+        if ( !first ) first = sif.ip;
+    }
+
+    //*** arrived on one of ours but not from a local subnet ***
+    return first;
+}
+
+#endif // Q_OS_LINUX
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief EpollDevice::~EpollDevice
+ */
+//*****************************************************************************
+EpollDevice::~EpollDevice()
+{
+#if defined(Q_OS_LINUX)
+    if ( listenFd >= 0 ) ::close( listenFd );
+#endif
+}
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief FauxMoEpoll::FauxMoEpoll
+ * @param loops - <= 0 for one per core
+ * @param parent
+ */
+//*****************************************************************************
+FauxMoEpoll::FauxMoEpoll( int loops, QObject *parent )
+    : QObject(parent),
+      connections_(0),
+      discoveryEnabled_(false),
+      logOwner_(nullptr)
+{
+    loopCount_ = loops > 0 ? loops : qMax( 1, QThread::idealThreadCount() );
+}
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief FauxMoEpoll::~FauxMoEpoll
+ */
+//*****************************************************************************
+FauxMoEpoll::~FauxMoEpoll()
+{
+    stop();
+}
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief FauxMoEpoll::start
+ * @param interfaces - discovery is answered on their IPv4 addresses
+ * @param group - SSDP multicast group
+ * @param port - SSDP port
+ * @param limits - connection caps, sizes and timeouts
+ * @return
+ */
+//*****************************************************************************
+bool FauxMoEpoll::start( const QList<QNetworkInterface> &interfaces, QHostAddress group, quint16 port,
+                         const ConnectionLimits &limits )
+{
+#if defined(Q_OS_LINUX)
+QList<EpollInterface> ifs;
+
+    if ( !loops_.isEmpty() ) return true;
+
+    limits_ = limits;
+
+    foreach( auto ni, interfaces )
+    {
+        foreach( auto entry, ni.addressEntries() )
+        {
+            if ( entry.ip().protocol() != QAbstractSocket::IPv4Protocol ) continue;
+
+            EpollInterface sif;
+            sif.ifIndex = ni.index();
+            sif.ip      = entry.ip().toIPv4Address();
+            sif.netmask = entry.netmask().toIPv4Address();
+            ifs.append( sif );
+        }
+    }
+
+    for ( int i = 0; i < loopCount_; i++ )
+    {
+        EpollLoop *loop = new EpollLoop( this, i );
+        loops_.append( loop );
+
+        if ( !loop->open( ifs, group.toIPv4Address(), port ) )
+        {
+            stop();
+            return false;
+        }
+    }
+
+    //*** devices added before start ***
+    {
+        QMutexLocker lock( &devicesLock_ );
+        foreach( auto dev, devices_ )
+            foreach( auto loop, loops_ )
+                loop->post( EpollCommand::Add, dev );
+    }
+
+    foreach( auto loop, loops_ )
+        loop->start();
+
+    FAUXMO_LOG( General, Info, "", "epoll engine running %d loops", loopCount_ );
+
+    return true;
+#else
+    Q_UNUSED( interfaces );
+    Q_UNUSED( group );
+    Q_UNUSED( port );
+    Q_UNUSED( limits );
+    FAUXMO_LOG( General, Error, "", "The epoll engine is only available on Linux" );
+    return false;
+#endif
+}
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief FauxMoEpoll::stop
+ */
+//*****************************************************************************
+void FauxMoEpoll::stop()
+{
+#if defined(Q_OS_LINUX)
+    foreach( auto loop, loops_ )
+    {
+        loop->requestStop();
+        loop->wait();
+    }
+
+    qDeleteAll( loops_ );
+#endif
+    loops_.clear();
+}
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief FauxMoEpoll::addDevice - binds the port here rather than in each
+ *        loop, so a port in use is reported to the caller
+ * @param name
+ * @param uuid
+ * @param port
+ * @param state
+ * @return - false if the name exists or the port can't be opened
+ */
+//*****************************************************************************
+bool FauxMoEpoll::addDevice( QString name, QString uuid, quint16 port, bool state )
+{
+#if defined(Q_OS_LINUX)
+    QMutexLocker lock( &devicesLock_ );
+
+    if ( devices_.contains( name ) ) return false;
+
+    EpollDevicePtr dev( new EpollDevice( name, uuid, port, state ) );
+
+    dev->listenFd = openListener( port );
+    if ( dev->listenFd < 0 )
+    {
+        FAUXMO_LOG( Device, Error, name, "Error listening on TCP port %u: %s", unsigned(port), strerror( errno ) );
+        return false;
+    }
+
+    devices_.insert( name, dev );
+
+    foreach( auto loop, loops_ )
+        loop->post( EpollCommand::Add, dev );
+
+    return true;
+#else
+    Q_UNUSED( name );
+    Q_UNUSED( uuid );
+    Q_UNUSED( port );
+    Q_UNUSED( state );
+    return false;
+#endif
+}
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief FauxMoEpoll::removeDevice - waits for every loop to stop watching
+ *        the port and closes it, so it can be reused on return
+ * @param name
+ */
+//*****************************************************************************
+void FauxMoEpoll::removeDevice( QString name )
+{
+    EpollDevicePtr dev;
+    {
+        QMutexLocker lock( &devicesLock_ );
+        dev = devices_.take( name );
+    }
+
+    if ( !dev ) return;
+
+#if defined(Q_OS_LINUX)
+    QSharedPointer<QSemaphore> released( new QSemaphore );
+
+    foreach( auto loop, loops_ )
+        loop->post( EpollCommand::Remove, dev, released );
+
+    //*** a loop still watching could accept on a reused fd number - leave it
+    //*** to the destructor then ***
+    if ( !released->tryAcquire( loops_.size(), EPOLL_REMOVE_WAIT_MS ) )
+    {
+        FAUXMO_LOG( Device, Error, name, "epoll loops did not release TCP port %u", unsigned(dev->port) );
+        return;
+    }
+
+    ::close( dev->listenFd );
+    dev->listenFd = -1;
+#endif
+}
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief FauxMoEpoll::renameDevice - keeps port, uuid and open connections
+ * @param oldName
+ * @param newName
+ */
+//*****************************************************************************
+void FauxMoEpoll::renameDevice( QString oldName, QString newName )
+{
+    QMutexLocker lock( &devicesLock_ );
+
+    EpollDevicePtr dev = devices_.take( oldName );
+    if ( !dev ) return;
+
+    {
+        QMutexLocker devLock( &dev->lock );
+        dev->protocol.setName( newName );
+    }
+
+    devices_.insert( newName, dev );
+}
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief FauxMoEpoll::setState
+ * @param name
+ * @param state
+ */
+//*****************************************************************************
+void FauxMoEpoll::setState( QString name, bool state )
+{
+    QMutexLocker lock( &devicesLock_ );
+
+    EpollDevicePtr dev = devices_.value( name );
+    if ( !dev ) return;
+
+    QMutexLocker devLock( &dev->lock );
+    dev->protocol.setState( state );
+}
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief FauxMoEpoll::state
+ * @param name
+ * @return
+ */
+//*****************************************************************************
+bool FauxMoEpoll::state( QString name ) const
+{
+    QMutexLocker lock( &devicesLock_ );
+
+    EpollDevicePtr dev = devices_.value( name );
+    if ( !dev ) return false;
+
+    QMutexLocker devLock( &dev->lock );
+    return dev->protocol.state();
+}
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief FauxMoEpoll::setGroups
+ * @param groups
+ */
+//*****************************************************************************
+void FauxMoEpoll::setGroups( const QHash<QString,QStringList> &groups )
+{
+    QMutexLocker lock( &devicesLock_ );
+
+    groups_ = groups;
+}
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief FauxMoEpoll::switchMembers - runs on the loop thread that handled
+ *        the request, before the response is written. The group's own lock
+ *        is not held.
+ * @param group - device that was set, nothing happens if it's not a group
+ * @param state
+ */
+//*****************************************************************************
+void FauxMoEpoll::switchMembers( const QString &group, bool state )
+{
+    QMutexLocker lock( &devicesLock_ );
+
+    auto it = groups_.constFind( group );
+    if ( it == groups_.constEnd() ) return;
+
+    //*** members served by another worker are not in the table ***
+    foreach( auto member, it.value() )
+    {
+        EpollDevicePtr dev = devices_.value( member );
+        if ( !dev ) continue;
+
+        QMutexLocker devLock( &dev->lock );
+        dev->protocol.setState( state );
+    }
+}
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief FauxMoEpoll::sendMulticast
+ * @param msg
+ */
+//*****************************************************************************
+void FauxMoEpoll::sendMulticast( const QByteArray &msg )
+{
+#if defined(Q_OS_LINUX)
+    if ( !loops_.isEmpty() ) loops_.first()->sendMulticast( msg );
+#else
+    Q_UNUSED( msg );
+#endif
+}
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief FauxMoEpoll::stats
+ * @return
+ */
+//*****************************************************************************
+ConnectionStats FauxMoEpoll::stats() const
+{
+ConnectionStats total;
+
+#if defined(Q_OS_LINUX)
+    foreach( auto loop, loops_ )
+    {
+        total.accepted               += loop->accepted.load();
+        total.rejectedGlobalLimit    += loop->rejectedGlobalLimit.load();
+        total.rejectedDeviceLimit    += loop->rejectedDeviceLimit.load();
+        total.rejectedHeaderTooLarge += loop->rejectedHeaderTooLarge.load();
+        total.rejectedBodyTooLarge   += loop->rejectedBodyTooLarge.load();
+        total.idleTimeouts           += loop->idleTimeouts.load();
+        total.requestTimeouts        += loop->requestTimeouts.load();
+    }
+#endif
+
+    return total;
+}
@@ -0,0 +1,162 @@
+#ifndef FAUXMOEPOLL_H
+#define FAUXMOEPOLL_H
+
+#include <QObject>
+#include <QMutex>
+#include <QSemaphore>
+#include <QHash>
+#include <QList>
+#include <QSharedPointer>
+#include <QNetworkInterface>
+#include <QHostAddress>
+
+#include <atomic>
+
+#include "ConnectionGuard.h"
+#include "FauxMoProtocol.h"
+
+class EpollLoop;
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief The EpollDevice struct - a device served by the epoll engine,
+ *        shared by all loops
+ */
+//*****************************************************************************
+struct EpollDevice
+{
+    EpollDevice( QString name, QString uuid, quint16 port, bool state )
+        : protocol(name, uuid), port(port), listenFd(-1), connections(0) { protocol.setState( state ); }
+
+    //*** closes the listening socket if FauxMoEpoll has not ***
+    ~EpollDevice();
+
+    //*** guards protocol - name and state change from other threads ***
+    QMutex       lock;
+    WemoProtocol protocol;
+
+    quint16      port;
+
+    //*** one listening socket, watched by every loop ***
+    int          listenFd;
+
+    //*** open connections across all loops ***
+    std::atomic<int> connections;
+};
+
+typedef QSharedPointer<EpollDevice> EpollDevicePtr;
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief The EpollInterface struct - an IPv4 address we answer discovery on
+ */
+//*****************************************************************************
+struct EpollInterface
+{
+    int     ifIndex;
+    quint32 ip;
+    quint32 netmask;
+};
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief The FauxMoEpoll class - native Linux engine serving SSDP and the
+ *        Wemo HTTP protocol from epoll loops (edge triggered, non-blocking
+ *        sockets), one thread per loop. Loop 0 answers discovery. Each
+ *        device port is a single listening socket, bound without
+ *        SO_REUSEPORT so a port in use fails at addDevice, and watched by
+ *        every loop with EPOLLEXCLUSIVE so one loop is woken per connection.
+ *        Used by FauxMoQt in place of the Qt sockets.
+ */
+//*****************************************************************************
+class FauxMoEpoll : public QObject
+{
+    Q_OBJECT
+
+public:
+
+    //*** constructor - loops <= 0 for one per core ***
+    explicit FauxMoEpoll( int loops, QObject *parent = nullptr );
+
+    //*** destructor - stops the loops ***
+    ~FauxMoEpoll();
+
+    //*** opens the sockets and starts the loops ***
+    bool start( const QList<QNetworkInterface> &interfaces, QHostAddress group, quint16 port,
+                const ConnectionLimits &limits );
+
+    //*** stops and joins the loops ***
+    void stop();
+
+    //*** device table - may be called before or after start. addDevice binds
+    //*** the port and fails if it can't, removeDevice frees it before returning ***
+    bool addDevice( QString name, QString uuid, quint16 port, bool state );
+    void removeDevice( QString name );
+    void renameDevice( QString oldName, QString newName );
+    void setState( QString name, bool state );
+
+    //*** state the loops serve, false if not found ***
+    bool state( QString name ) const;
+
+    //*** group devices and their member names - a SetBinaryState on a group
+    //*** switches the members before the response is written ***
+    void setGroups( const QHash<QString,QStringList> &groups );
+
+    //*** multicast to the SSDP group on every interface from loop 0's
+    //*** socket - safe from any thread, dropped before start ***
+    void sendMulticast( const QByteArray &msg );
+
+    //*** answer M-SEARCH or not ***
+    void setDiscoveryEnabled( bool en ) { discoveryEnabled_.store( en ); }
+    bool discoveryEnabled() const { return discoveryEnabled_.load(); }
+
+    //*** accepted/rejected/expired connections, summed over loops ***
+    ConnectionStats stats() const;
+
+    int loopCount() const { return loopCount_; }
+
+    //*** log records from the loop threads are tagged with this ***
+    void setLogOwner( const void *owner ) { logOwner_ = owner; }
+
+
+signals:
+
+    //*** SetBinaryState received - emitted from a loop thread after the
+    //*** device (and a group's members) were switched ***
+    void deviceStateSet( QString devName, bool state );
+
+
+private:
+
+    friend class EpollLoop;
+
+    Q_DISABLE_COPY( FauxMoEpoll )
+
+    //*** called by a loop when a SetBinaryState was handled ***
+    void switchMembers( const QString &group, bool state );
+
+    //*** open connections across all loops ***
+    std::atomic<int> connections_;
+
+    std::atomic<bool> discoveryEnabled_;
+
+    int loopCount_;
+
+    const void *logOwner_;
+    QList<EpollLoop*> loops_;
+
+    ConnectionLimits limits_;
+
+    //*** devices by name, groups by name - taken before a device's lock ***
+    mutable QMutex devicesLock_;
+    QHash<QString,EpollDevicePtr> devices_;
+    QHash<QString,QStringList> groups_;
+};
+
+#endif // FAUXMOEPOLL_H
@@ -18,15 +18,47 @@ DEFINES += QT_DEPRECATED_WARNINGS
 #DEFINES += QT_DISABLE_DEPRECATED_BEFORE=0x060000    # disables all the APIs deprecated before Qt 6.0.0
 
 SOURCES += \
+    ConnectionGuard.cpp \
+    ConnectionPool.cpp \
+    FauxMoCapture.cpp \
+    FauxMoEpoll.cpp \
+    FauxMoLog.cpp \
+    FauxMoProtocol.cpp \
     FauxMoQt.cpp \
+    FauxMoReplay.cpp \
+    FauxMoSoak.cpp \
+    FauxMoTrace.cpp \
+    HueBridge.cpp \
+    LoopWatchdog.cpp \
+    StateExport.cpp \
     WemoDevice.cpp
 
 HEADERS += \
+    ConnectionGuard.h \
+    ConnectionPool.h \
+    FauxMoCapture.h \
+    FauxMoEpoll.h \
     FauxMoLib_global.h \
+    FauxMoLog.h \
+    FauxMoProtocol.h \
     FauxMoQt.h \
+    FauxMoReplay.h \
+    FauxMoShm.h \
+    FauxMoSoak.h \
+    FauxMoTrace.h \
     FauxMo_Templates.h \
+    HueBridge.h \
+    LoopWatchdog.h \
+    StateExport.h \
     WemoDevice.h
 
+# coverage for the fuzz target - see fuzz/fuzz.pro
+fauxmo_fuzz: QMAKE_CXXFLAGS += -fsanitize=fuzzer-no-link,address
+fauxmo_fuzz: QMAKE_LFLAGS += -fsanitize=address
+
+# shm_open lives in librt on older glibc
+unix:!macx: LIBS += -lrt
+
 # Default rules for deployment.
 unix {
     target.path = /usr/lib
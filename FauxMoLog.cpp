@@ -0,0 +1,441 @@
+#include "FauxMoLog.h"
+
+#include <QThread>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QSemaphore>
+#include <QList>
+#include <QDateTime>
+
+#include <cstdarg>
+#include <cstdio>
+
+//*** ring size - must be a power of 2 ***
+const quint64 LOG_RING_SIZE = 4096;
+
+//*** owner stamped on records by FauxMoLogScope ***
+static thread_local const void *logOwner = nullptr;
+
+//*** defaults to Info for every category ***
+std::atomic<int> FauxMoLog::levels_[FauxMoLog::CategoryCount] =
+    { {FauxMoLog::Info}, {FauxMoLog::Info}, {FauxMoLog::Info}, {FauxMoLog::Info} };
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief The LogRing class - bounded multi-producer / single-consumer ring,
+ *        each cell carries a sequence number so producers never take a lock
+ */
+//*****************************************************************************
+class LogRing
+{
+public:
+
+    LogRing() : head_(0), tail_(0), dropped_(0)
+    {
+        for ( quint64 i = 0; i < LOG_RING_SIZE; i++ )
+            cells_[i].seq.store( i, std::memory_order_relaxed );
+    }
+
+    //*** claims a cell for writing, nullptr if full ***
+    LogRecord *claim( quint64 &pos )
+    {
+        pos = head_.load( std::memory_order_relaxed );
+
+        for (;;)
+        {
+            Cell &cell = cells_[pos & (LOG_RING_SIZE - 1)];
+            qint64 diff = qint64( cell.seq.load( std::memory_order_acquire ) ) - qint64( pos );
+
+            if ( diff == 0 )
+            {
+                if ( head_.compare_exchange_weak( pos, pos + 1, std::memory_order_relaxed ) )
+                    return &cell.rec;
+            }
+            else if ( diff < 0 )
+            {
+                dropped_.fetch_add( 1, std::memory_order_relaxed );
+                return nullptr;
+            }
+            else
+            {
+                pos = head_.load( std::memory_order_relaxed );
+            }
+        }
+    }
+
+    //*** publishes a claimed cell ***
+    void publish( quint64 pos )
+    {
+        cells_[pos & (LOG_RING_SIZE - 1)].seq.store( pos + 1, std::memory_order_release );
+    }
+
+    //*** single consumer - returns next record or nullptr ***
+    const LogRecord *peek()
+    {
+        Cell &cell = cells_[tail_ & (LOG_RING_SIZE - 1)];
+        if ( cell.seq.load( std::memory_order_acquire ) != tail_ + 1 ) return nullptr;
+        return &cell.rec;
+    }
+
+    //*** releases the record returned by peek ***
+    void pop()
+    {
+        cells_[tail_ & (LOG_RING_SIZE - 1)].seq.store( tail_ + LOG_RING_SIZE, std::memory_order_release );
+        tail_++;
+    }
+
+    quint64 dropped() const { return dropped_.load( std::memory_order_relaxed ); }
+
+private:
+
+    struct Cell
+    {
+        std::atomic<quint64> seq;
+        LogRecord rec;
+    };
+
+    Cell cells_[LOG_RING_SIZE];
+
+    std::atomic<quint64> head_;
+    quint64 tail_;
+    std::atomic<quint64> dropped_;
+};
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief The LogThread class - drains the ring into the sinks, sleeps on a
+ *        semaphore while the ring is empty
+ */
+//*****************************************************************************
+class LogThread : public QThread
+{
+public:
+
+    LogThread() : sleeping_(false), stop_(false) {}
+
+    void requestStop( bool stop )
+    {
+        stop_.store( stop );
+        if ( stop ) wake_.release();
+    }
+
+    //*** called by writers after publishing - wakes the thread if it's idle ***
+    void notify()
+    {
+        std::atomic_thread_fence( std::memory_order_seq_cst );
+
+        if ( sleeping_.load( std::memory_order_relaxed ) && sleeping_.exchange( false ) )
+            wake_.release();
+    }
+
+    //*** drains everything queued so far ***
+    void drain();
+
+    LogRing ring_;
+
+    //*** a sink and whose records it wants ***
+    struct SinkEntry
+    {
+        const void *owner;
+        FauxMoLog::Sink sink;
+        bool ownRecordsOnly;
+    };
+
+    QMutex sinkLock_;
+    QList<SinkEntry> sinks_;
+
+protected:
+
+    void run() override
+    {
+        while ( !stop_.load() )
+        {
+            drain();
+
+            //*** announce we're going to sleep, then re-check so a record
+            //*** published in between is not left waiting ***
+            sleeping_.store( true );
+            std::atomic_thread_fence( std::memory_order_seq_cst );
+
+            bool pending;
+            {
+                QMutexLocker lock( &sinkLock_ );
+                pending = ring_.peek() != nullptr;
+            }
+
+            //*** a writer may also have woken us - costs one extra pass ***
+            if ( pending || stop_.load() )
+            {
+                sleeping_.store( false );
+                continue;
+            }
+
+            wake_.acquire();
+        }
+
+        drain();
+    }
+
+private:
+
+    QSemaphore wake_;
+    std::atomic<bool> sleeping_;
+    std::atomic<bool> stop_;
+};
+
+
+//*** log thread, running while there are sinks - never deleted so a late
+//*** writer on another thread can't touch a freed ring ***
+static QMutex logThreadLock;
+static std::atomic<bool> logActive( false );
+
+static LogThread *logThread()
+{
+    static LogThread *t = new LogThread;
+    return t;
+}
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief LogThread::drain
+ */
+//*****************************************************************************
+void LogThread::drain()
+{
+    QMutexLocker lock( &sinkLock_ );
+
+    while ( const LogRecord *rec = ring_.peek() )
+    {
+        for ( int i = 0; i < sinks_.size(); i++ )
+        {
+            const SinkEntry &entry = sinks_[i];
+
+            //*** written under another instance's scope ***
+            if ( entry.ownRecordsOnly && rec->owner && rec->owner != entry.owner ) continue;
+
+            entry.sink( *rec );
+        }
+
+        ring_.pop();
+    }
+}
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief FauxMoLog::setLevel
+ * @param cat
+ * @param lvl
+ */
+//*****************************************************************************
+void FauxMoLog::setLevel( Category cat, Level lvl )
+{
+    levels_[cat].store( int(lvl) );
+}
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief FauxMoLog::setLevel - all categories
+ * @param lvl
+ */
+//*****************************************************************************
+void FauxMoLog::setLevel( Level lvl )
+{
+    for ( int i = 0; i < CategoryCount; i++ )
+        levels_[i].store( int(lvl) );
+}
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief FauxMoLog::write
+ * @param cat
+ * @param lvl
+ * @param subject
+ * @param fmt - printf style format
+ */
+//*****************************************************************************
+void FauxMoLog::write( Category cat, Level lvl, const QString &subject, const char *fmt, ... )
+{
+quint64 pos = 0;
+va_list args;
+
+    //*** nobody listening ***
+    if ( !logActive.load( std::memory_order_acquire ) ) return;
+
+    LogThread *t = logThread();
+
+    //*** get a cell - drop if full ***
+    LogRecord *rec = t->ring_.claim( pos );
+    if ( !rec ) return;
+
+    rec->timestampMs = QDateTime::currentMSecsSinceEpoch();
+    rec->level       = quint8(lvl);
+    rec->category    = quint8(cat);
+    rec->owner       = logOwner;
+
+    qstrncpy( rec->subject, subject.toUtf8().constData(), sizeof(rec->subject) );
+
+    va_start( args, fmt );
+    vsnprintf( rec->text, sizeof(rec->text), fmt, args );
+    va_end( args );
+
+    t->ring_.publish( pos );
+    t->notify();
+}
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief FauxMoLog::setOwner
+ * @param owner
+ * @return - previous owner
+ */
+//*****************************************************************************
+const void *FauxMoLog::setOwner( const void *owner )
+{
+    const void *prev = logOwner;
+    logOwner = owner;
+
+    return prev;
+}
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief FauxMoLog::addSink - starts the log thread with the first sink
+ * @param owner
+ * @param sink
+ * @param ownRecordsOnly - skip records stamped with another owner
+ */
+//*****************************************************************************
+void FauxMoLog::addSink( const void *owner, Sink sink, bool ownRecordsOnly )
+{
+    QMutexLocker lock( &logThreadLock );
+
+    LogThread *t = logThread();
+
+    {
+        QMutexLocker sinkLock( &t->sinkLock_ );
+        LogThread::SinkEntry entry;
+        entry.owner          = owner;
+        entry.sink           = sink;
+        entry.ownRecordsOnly = ownRecordsOnly;
+        t->sinks_.append( entry );
+    }
+
+    if ( !t->isRunning() )
+    {
+        t->requestStop( false );
+        t->start( QThread::LowPriority );
+        logActive.store( true, std::memory_order_release );
+    }
+}
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief FauxMoLog::removeSinks - stops the log thread with the last sink
+ * @param owner
+ */
+//*****************************************************************************
+void FauxMoLog::removeSinks( const void *owner )
+{
+    QMutexLocker lock( &logThreadLock );
+
+    LogThread *t = logThread();
+
+    //*** flush what this owner's sinks should still see ***
+    if ( t->isRunning() ) t->drain();
+
+    bool empty = false;
+    {
+        QMutexLocker sinkLock( &t->sinkLock_ );
+
+        for ( int i = t->sinks_.size() - 1; i >= 0; i-- )
+        {
+            if ( t->sinks_[i].owner == owner )
+                t->sinks_.removeAt( i );
+        }
+
+        empty = t->sinks_.isEmpty();
+    }
+
+    //*** last one - stop the thread ***
+    if ( empty && t->isRunning() )
+    {
+        logActive.store( false, std::memory_order_release );
+
+        t->requestStop( true );
+        t->wait();
+    }
+}
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief FauxMoLog::dropped
+ * @return
+ */
+//*****************************************************************************
+quint64 FauxMoLog::dropped()
+{
+    return logThread()->ring_.dropped();
+}
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief FauxMoLog::levelName
+ * @param lvl
+ * @return
+ */
+//*****************************************************************************
+const char *FauxMoLog::levelName( Level lvl )
+{
+    switch ( lvl )
+    {
+        case Trace:   return "trace";
+        case Debug:   return "debug";
+        case Info:    return "info";
+        case Warning: return "warning";
+        case Error:   return "error";
+        default:      return "off";
+    }
+}
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief FauxMoLog::categoryName
+ * @param cat
+ * @return
+ */
+//*****************************************************************************
+const char *FauxMoLog::categoryName( Category cat )
+{
+    switch ( cat )
+    {
+        case General:    return "general";
+        case Discovery:  return "discovery";
+        case Device:     return "device";
+        case Connection: return "connection";
+        default:         return "unknown";
+    }
+}
@@ -0,0 +1,135 @@
+#ifndef FAUXMOLOG_H
+#define FAUXMOLOG_H
+
+#include "FauxMoLib_global.h"
+
+#include <QObject>
+#include <QString>
+
+#include <atomic>
+#include <functional>
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief The LogRecord struct - one fixed size log entry
+ */
+//*****************************************************************************
+struct LogRecord
+{
+    qint64 timestampMs;     // ms since epoch
+    quint8 level;           // FauxMoLog::Level
+    quint8 category;        // FauxMoLog::Category
+    char   subject[48];     // device name or component
+    char   text[200];       // formatted message
+    const void *owner;      // FauxMoLogScope owner, nullptr if none
+};
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief The FauxMoLog class - leveled, per category logging. Messages below
+ *        the category level are dropped before any formatting. Enabled
+ *        messages are formatted into a lock-free ring and handed to the sinks
+ *        from a background thread.
+ */
+//*****************************************************************************
+class FAUXMOLIB_EXPORT FauxMoLog
+{
+public:
+
+    enum Level
+    {
+        Trace = 0,
+        Debug,
+        Info,
+        Warning,
+        Error,
+        Off
+    };
+
+    enum Category
+    {
+        General = 0,
+        Discovery,
+        Device,
+        Connection,
+        CategoryCount
+    };
+
+    //*** sink called on the log thread for every record ***
+    typedef std::function<void(const LogRecord&)> Sink;
+
+    //*** true if a message would be recorded - cheap, call before formatting ***
+    static bool enabled( Category cat, Level lvl )
+    {
+        return int(lvl) >= levels_[cat].load( std::memory_order_relaxed );
+    }
+
+    //*** sets the minimum level for a category (or all categories) ***
+    static void setLevel( Category cat, Level lvl );
+    static void setLevel( Level lvl );
+    static Level level( Category cat ) { return Level( levels_[cat].load() ); }
+
+    //*** formats and queues a record - use FAUXMO_LOG instead ***
+    static void write( Category cat, Level lvl, const QString &subject, const char *fmt, ... )
+#if defined(Q_CC_GNU) || defined(Q_CC_CLANG)
+        __attribute__((format(printf, 4, 5)))
+#endif
+        ;
+
+    //*** sinks, keyed by owner so they can be removed - with ownRecordsOnly a
+    //*** sink skips records written under another owner's FauxMoLogScope ***
+    static void addSink( const void *owner, Sink sink, bool ownRecordsOnly = false );
+    static void removeSinks( const void *owner );
+
+    //*** owner stamped on records written by this thread, returns the previous ***
+    static const void *setOwner( const void *owner );
+
+    //*** records dropped because the ring was full ***
+    static quint64 dropped();
+
+    //*** names for display ***
+    static const char *levelName( Level lvl );
+    static const char *categoryName( Category cat );
+
+
+private:
+
+    //*** per category minimum level ***
+    static std::atomic<int> levels_[CategoryCount];
+};
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief The FauxMoLogScope class - records written by this thread until
+ *        destruction belong to 'owner' (a FauxMoQt instance), scopes nest
+ */
+//*****************************************************************************
+class FauxMoLogScope
+{
+public:
+
+    explicit FauxMoLogScope( const void *owner ) : prev_( FauxMoLog::setOwner( owner ) ) {}
+
+    ~FauxMoLogScope() { FauxMoLog::setOwner( prev_ ); }
+
+private:
+
+    Q_DISABLE_COPY( FauxMoLogScope )
+
+    const void *prev_;
+};
+
+
+//*** log only if enabled - arguments are not evaluated otherwise ***
+#define FAUXMO_LOG( cat, lvl, subject, ... ) \
+    do { \
+        if ( FauxMoLog::enabled( FauxMoLog::cat, FauxMoLog::lvl ) ) \
+            FauxMoLog::write( FauxMoLog::cat, FauxMoLog::lvl, subject, __VA_ARGS__ ); \
+    } while (0)
+
+#endif // FAUXMOLOG_H
@@ -0,0 +1,411 @@
+#include "FauxMoProtocol.h"
+#include "FauxMo_Templates.h"
+#include "FauxMoLog.h"
+
+#include <QDateTime>
+#include <cstring>
+#include <algorithm>
+
+//*** search header by SsdpTarget - the ST value starts after the prefix ***
+static const char *const SEARCH_PATTERNS[SsdpTargetCount] =
+{
+    "ST: urn:Belkin:device:controllee:1",
+    "ST: upnp:rootdevice",
+    "ST: ssdp:all",
+    "ST: urn:schemas-upnp-org:device:basic:1"
+};
+
+static const int SEARCH_PREFIX_LEN = 4;
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief FauxMoProtocol::classifySearch
+ * @param data - datagram
+ * @param len
+ * @return
+ */
+//*****************************************************************************
+SsdpTarget FauxMoProtocol::classifySearch( const char *data, int len )
+{
+    if ( find( data, len, "M-SEARCH" ) < 0 ) return SsdpNone;
+
+    //*** first matching "ST: <target>" wins ***
+    for ( int i = 0; i < SsdpTargetCount; i++ )
+    {
+        if ( find( data, len, SEARCH_PATTERNS[i] ) >= 0 ) return SsdpTarget(i);
+    }
+
+    return SsdpNone;
+}
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief FauxMoProtocol::searchTarget
+ * @param target
+ * @return
+ */
+//*****************************************************************************
+const char *FauxMoProtocol::searchTarget( SsdpTarget target )
+{
+    if ( target < 0 || target >= SsdpTargetCount ) return "";
+
+    return SEARCH_PATTERNS[target] + SEARCH_PREFIX_LEN;
+}
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief FauxMoProtocol::renderSearchResponses - renders with an empty date,
+ *        then splits at the date so only the date changes per send
+ * @param location - ip:port of the device's setup.xml
+ * @param uuid
+ * @param head - receives the part before the date (same for all devices)
+ * @param tails - receives the part after the date, indexed by SsdpTarget
+ */
+//*****************************************************************************
+void FauxMoProtocol::renderSearchResponses( const QString &location, const QString &uuid,
+                                            QByteArray &head, QVector<QByteArray> &tails )
+{
+    tails.clear();
+
+    for ( int i = 0; i < SsdpTargetCount; i++ )
+    {
+        QString target = searchTarget( SsdpTarget(i) );
+
+        QByteArray response = QString(UDP_RESPONSE_TEMPLATE)
+                .arg(QString()).arg(location).arg(uuid).arg(target).arg(target).toUtf8();
+
+        int datePos = response.indexOf( "DATE: " ) + 6;
+
+        head = response.left( datePos );
+        tails.append( response.mid( datePos ) );
+    }
+}
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief FauxMoProtocol::assembleSearchResponse
+ * @param out - emptied first
+ * @param head
+ * @param tail
+ */
+//*****************************************************************************
+void FauxMoProtocol::assembleSearchResponse( QByteArray &out, const QByteArray &head, const QByteArray &tail )
+{
+    out.resize( 0 );
+    out.append( head ).append( httpDate() ).append( tail );
+}
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief FauxMoProtocol::appendHttpHeader - template is split once, nothing
+ *        is allocated if 'out' has room
+ * @param out
+ * @param bodyLen
+ */
+//*****************************************************************************
+void FauxMoProtocol::appendHttpHeader( QByteArray &out, int bodyLen )
+{
+static const QByteArray hdr( HTTP_HEADER );
+static const int p1 = hdr.indexOf( "%1" );
+static const int p2 = hdr.indexOf( "%2" );
+char length[16];
+
+    qsnprintf( length, sizeof(length), "%d", bodyLen );
+
+    //*** HTTP_HEADER around %1 (length) and %2 (date) ***
+    out.append( hdr.constData(), p1 ).append( length );
+    out.append( hdr.constData() + p1 + 2, p2 - p1 - 2 ).append( httpDate() );
+    out.append( hdr.constData() + p2 + 2, hdr.size() - p2 - 2 );
+}
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief FauxMoProtocol::httpDate - one copy per thread
+ * @return
+ */
+//*****************************************************************************
+const QByteArray &FauxMoProtocol::httpDate()
+{
+static thread_local qint64 dateSecs = -1;
+static thread_local QByteArray date;
+
+    qint64 secs = QDateTime::currentMSecsSinceEpoch() / 1000;
+    if ( secs != dateSecs )
+    {
+        dateSecs = secs;
+        date     = QDateTime::currentDateTime().toString( Qt::RFC2822Date ).toUtf8();
+    }
+
+    return date;
+}
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief FauxMoProtocol::find
+ * @param data
+ * @param len
+ * @param needle - NUL terminated
+ * @return
+ */
+//*****************************************************************************
+int FauxMoProtocol::find( const char *data, int len, const char *needle )
+{
+    if ( !data || len <= 0 ) return -1;
+
+    const char *end = data + len;
+    const char *hit = std::search( data, end, needle, needle + strlen( needle ) );
+
+    return hit == end ? -1 : int( hit - data );
+}
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief FauxMoProtocol::contentLength - scans the header in place
+ * @param header - request line and headers
+ * @param len - bytes of header
+ * @return - body length, 0 if not present or invalid
+ */
+//*****************************************************************************
+qint64 FauxMoProtocol::contentLength( const char *header, int len )
+{
+static const char name[] = "content-length:";
+const int nameLen = int(sizeof(name)) - 1;
+
+    for ( int i = 0; i + nameLen <= len; i++ )
+    {
+        //*** header names start a line ***
+        if ( i > 0 && header[i - 1] != '\n' ) continue;
+        if ( qstrnicmp( header + i, name, uint(nameLen) ) != 0 ) continue;
+
+        qint64 value = 0;
+        for ( int j = i + nameLen; j < len && header[j] != '\r' && header[j] != '\n'; j++ )
+        {
+            if ( header[j] == ' ' || header[j] == '\t' ) continue;
+            if ( header[j] < '0' || header[j] > '9' ) return 0;
+
+            //*** anything this big is rejected anyway ***
+            if ( value > ( qint64(1) << 40 ) ) break;
+            value = value * 10 + ( header[j] - '0' );
+        }
+
+        return value;
+    }
+
+    return 0;
+}
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief WemoProtocol::WemoProtocol
+ * @param name
+ * @param uuid
+ */
+//*****************************************************************************
+WemoProtocol::WemoProtocol( QString name, QString uuid )
+    : name_(name),
+      uuid_(uuid),
+      state_(false)
+{
+}
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief WemoProtocol::handleRequest
+ * @param data - one complete request
+ * @param len
+ * @param out - response is appended
+ * @return
+ */
+//*****************************************************************************
+WemoProtocol::Result WemoProtocol::handleRequest( const char *data, int len, QByteArray &out )
+{
+QByteArray body;
+Result result = Response;
+
+    //*** determine how to handle this message ***
+    if ( FauxMoProtocol::find( data, len, "GET /setup.xml HTTP/1.1" ) >= 0 )
+        body = handleSetup();
+    else if ( FauxMoProtocol::find( data, len, "/eventservice.xml" ) >= 0 )
+        body = handleEvent();
+    else if ( FauxMoProtocol::find( data, len, "/metainfoservice.xml" ) >= 0 )
+        body = handleMetaInfo();
+    else if ( FauxMoProtocol::find( data, len, "POST /upnp/control/basicevent1 HTTP/1.1" ) >= 0 )
+        body = handleAction( data, len, result );
+    else
+        FAUXMO_LOG( Device, Debug, name_, "Unknown TCP message received" );
+
+    //*** if no body, then no response expected ***
+    if ( body.isEmpty() ) return NoResponse;
+
+    //*** add the http header and create a full message ***
+    FauxMoProtocol::appendHttpHeader( out, body.size() );
+    out.append( body );
+
+    return result;
+}
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief WemoProtocol::handleSetup
+ * @return - body of setup message
+ */
+//*****************************************************************************
+QByteArray WemoProtocol::handleSetup()
+{
+    //*** create from template on first use ***
+    if ( setupBody_.isEmpty() )
+        setupBody_ = QString( SETUP_XML ).arg( name_ ).arg( uuid_ ).toUtf8();
+
+    return setupBody_;
+}
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief WemoProtocol::handleEvent
+ * @return - body of event message
+ */
+//*****************************************************************************
+QByteArray WemoProtocol::handleEvent()
+{
+static const QByteArray body( EVENT_SERVICE_XML );
+
+    return body;
+}
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief WemoProtocol::handleMetaInfo
+ * @return
+ */
+//*****************************************************************************
+QByteArray WemoProtocol::handleMetaInfo()
+{
+static const QByteArray body( METAINFO_XML );
+
+    return body;
+}
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief renderBinaryState
+ * @param set - Set or Get response
+ * @param state
+ * @return
+ */
+//*****************************************************************************
+static QByteArray renderBinaryState( bool set, bool state )
+{
+    return QString( SOAP_RESPONSE ).arg( set ? "Set" : "Get" ).arg( "BinaryState" ).arg( state ? "1" : "0" ).toUtf8();
+}
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief binaryStateBody - SOAP BinaryState responses are the same for every
+ *        device, rendered once
+ * @param set - Set or Get response
+ * @param state
+ * @return
+ */
+//*****************************************************************************
+static QByteArray binaryStateBody( bool set, bool state )
+{
+static const QByteArray bodies[2][2] =
+{
+    { renderBinaryState( false, false ), renderBinaryState( false, true ) },
+    { renderBinaryState( true,  false ), renderBinaryState( true,  true ) }
+};
+
+    return bodies[set][state];
+}
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief WemoProtocol::handleAction
+ * @param data
+ * @param len
+ * @param result - StateSet for SetBinaryState
+ * @return
+ */
+//*****************************************************************************
+QByteArray WemoProtocol::handleAction( const char *data, int len, Result &result )
+{
+QByteArray body;
+
+    //*** handle 'get state' action ***
+    if ( FauxMoProtocol::find( data, len, "GetBinaryState" ) >= 0 )
+    {
+        //*** return current state as a 'soap' response ***
+        body = binaryStateBody( false, state_ );
+    }
+
+    //*** handle 'set state' action ***
+    else if ( FauxMoProtocol::find( data, len, "SetBinaryState" ) >= 0 )
+    {
+        //*** off ***
+        if ( FauxMoProtocol::find( data, len, "<BinaryState>0</BinaryState>" ) >= 0 )
+        {
+            state_ = false;
+            result = StateSet;
+        }
+
+        //*** on ***
+        else if ( FauxMoProtocol::find( data, len, "<BinaryState>1</BinaryState>" ) >= 0 )
+        {
+            state_ = true;
+            result = StateSet;
+        }
+
+        //*** unknown ***
+        else
+        {
+            FAUXMO_LOG( Device, Warning, name_, "Invalid SetBinaryState msg" );
+        }
+
+        //*** create response from template ***
+        body = binaryStateBody( true, state_ );
+    }
+
+    //*** handle 'get friendly name' action ***
+    else if ( FauxMoProtocol::find( data, len, "GetFriendlyName" ) >= 0 )
+    {
+        //*** create from template on first use ***
+        if ( nameBody_.isEmpty() )
+            nameBody_ = QString( SOAP_RESPONSE ).arg("Get").arg("FriendlyName").arg(name_).toUtf8();
+
+        body = nameBody_;
+    }
+
+    return body;
+}
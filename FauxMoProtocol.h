@@ -0,0 +1,124 @@
+#ifndef FAUXMOPROTOCOL_H
+#define FAUXMOPROTOCOL_H
+
+#include "FauxMoLib_global.h"
+
+#include <QString>
+#include <QByteArray>
+#include <QVector>
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * Protocol core - SSDP search classification/response rendering and the
+ * Wemo HTTP exchange, with no sockets involved. Bytes in, bytes out, so it
+ * can be driven in-process by benchmarks and fuzzers. FauxMoQt and
+ * WemoDevice are the Qt socket adapters around it, FauxMoEpoll the native
+ * one. The static helpers may be called from any thread; a WemoProtocol
+ * object must be used by one thread at a time.
+ */
+//*****************************************************************************
+
+//*** search targets we answer, in match order ***
+enum SsdpTarget
+{
+    SsdpNone        = -1,
+    SsdpWemo        = 0,    // urn:Belkin:device:controllee:1
+    SsdpRootDevice,         // upnp:rootdevice
+    SsdpAll,                // ssdp:all
+    SsdpHue,                // urn:schemas-upnp-org:device:basic:1
+    SsdpTargetCount
+};
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief The FauxMoProtocol class - SSDP and HTTP helpers shared by the
+ *        adapters
+ */
+//*****************************************************************************
+class FAUXMOLIB_EXPORT FauxMoProtocol
+{
+public:
+
+    //*** search target of an M-SEARCH datagram, SsdpNone if not one we answer ***
+    static SsdpTarget classifySearch( const char *data, int len );
+
+    //*** ST value for a target ***
+    static const char *searchTarget( SsdpTarget target );
+
+    //*** renders a device's search responses after the date, one per target ***
+    static void renderSearchResponses( const QString &location, const QString &uuid,
+                                       QByteArray &head, QVector<QByteArray> &tails );
+
+    //*** head + date + tail into 'out' ***
+    static void assembleSearchResponse( QByteArray &out, const QByteArray &head, const QByteArray &tail );
+
+    //*** HTTP_HEADER with length and date appended to 'out' ***
+    static void appendHttpHeader( QByteArray &out, int bodyLen );
+
+    //*** current date in RFC 2822 format, re-rendered once a second ***
+    static const QByteArray &httpDate();
+
+    //*** offset of 'needle' in a byte span, -1 if not found ***
+    static int find( const char *data, int len, const char *needle );
+
+    //*** Content-Length of a request header, 0 if absent or invalid ***
+    static qint64 contentLength( const char *header, int len );
+};
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief The WemoProtocol class - state of one emulated Wemo switch and the
+ *        HTTP/SOAP requests served for it
+ */
+//*****************************************************************************
+class FAUXMOLIB_EXPORT WemoProtocol
+{
+public:
+
+    //*** what a request did ***
+    enum Result
+    {
+        NoResponse,     // not a request we serve
+        Response,       // response in 'out'
+        StateSet        // response in 'out', SetBinaryState received
+    };
+
+    //*** constructor ***
+    WemoProtocol( QString name, QString uuid );
+
+    //*** handles one complete request, appends the full response to 'out' ***
+    Result handleRequest( const char *data, int len, QByteArray &out );
+
+    //*** device info ***
+    void setName( QString name ) { name_ = name; setupBody_.clear(); nameBody_.clear(); }
+    void setUuid( QString uuid ) { uuid_ = uuid; setupBody_.clear(); }
+    void setState( bool state ) { state_ = state; }
+
+    QString name() const { return name_; }
+    QString uuid() const { return uuid_; }
+    bool state() const { return state_; }
+
+
+private:
+
+    //*** handlers for different TCP messages ***
+    QByteArray handleSetup();
+    QByteArray handleEvent();
+    QByteArray handleMetaInfo();
+    QByteArray handleAction( const char *data, int len, Result &result );
+
+    QString name_;
+    QString uuid_;
+    bool state_;
+
+    //*** rendered once, cleared when name or uuid change ***
+    QByteArray setupBody_;
+    QByteArray nameBody_;
+};
+
+#endif // FAUXMOPROTOCOL_H
@@ -1,27 +1,81 @@
 #include "FauxMoQt.h"
 #include "FauxMo_Templates.h"
 
-#include <QDebug>
+#if defined(Q_OS_UNIX)
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <unistd.h>
+#include <cstring>
+#endif
 
 //*****************************************************************************
 //*****************************************************************************
 /**
  * @brief FauxMoQt::FauxMoQt - Constructor
+ * @param engine
+ * @param loops
  */
 //*****************************************************************************
-FauxMoQt::FauxMoQt() : QObject()
+FauxMoQt::FauxMoQt( Engine engine, int loops ) : QObject()
 {
+    FauxMoLogScope logScope( this );
+
     //*** initialize vars ***
     haveInterface_ = false;
     discoveryEnabled_ = false;
+    udp_ = nullptr;
+
+    //*** Wemo switches unless told otherwise ***
+    emulationMode_ = WemoMode;
+    huePort_ = HUE_BRIDGE_PORT;
+    hueBridge_ = nullptr;
+
+    //*** reused for every discovery response ***
+    udpOut_.reserve( 1024 );
 
     //*** set up TCP port ***
     nextTcpPort_   = BASE_TCP_PORT;
 
-    //*** message patterns to respond to ***
-    patterns_ << "ST: urn:Belkin:device:controllee:1";
-    patterns_ << "ST: upnp:rootdevice";
-    patterns_ << "ST: ssdp:all";
+    //*** single process - owns every device ***
+    workerIndex_ = 0;
+    workerCount_ = 1;
+    lastTcpPort_ = 65535;
+    firstTcpPort_ = nextTcpPort_;
+
+    //*** config file - reload shortly after the last change ***
+    configWatcher_ = nullptr;
+    configReload_.setSingleShot( true );
+    configReload_.setInterval( CONFIG_RELOAD_DELAY_MS );
+    connect( &configReload_, SIGNAL(timeout()), SLOT(applyConfig()) );
+
+    //*** admission control for all device connections ***
+    connGuard_ = new ConnectionGuard( this );
+
+    //*** client connections are recycled between devices ***
+    connPool_ = new ConnectionPool( this );
+
+    //*** event loop stall detection (off until enabled) ***
+    watchdog_ = new LoopWatchdog( this );
+    connect( watchdog_, SIGNAL(stallDetected(QString,qint64)), SIGNAL(stallDetected(QString,qint64)) );
+
+    //*** native engine - state changes arrive from its loop threads ***
+    epoll_ = nullptr;
+#if defined(Q_OS_LINUX)
+    if ( engine == EpollEventLoop )
+    {
+        epoll_ = new FauxMoEpoll( loops );
+        epoll_->setLogOwner( this );
+        connect( epoll_, SIGNAL(deviceStateSet(QString,bool)), SLOT(epollStateSet(QString,bool)), Qt::QueuedConnection );
+    }
+#else
+    if ( engine == EpollEventLoop )
+        FAUXMO_LOG( General, Warning, "", "epoll engine not available, using Qt sockets" );
+    Q_UNUSED( loops );
+#endif
+
+    //*** log messages are delivered through msgOut/error by default ***
+    logSignals_ = false;
+    enableLogSignals( true );
 }
 
 
@@ -33,15 +87,29 @@ FauxMoQt::FauxMoQt() : QObject()
 //*****************************************************************************
 FauxMoQt::~FauxMoQt()
 {
+    FauxMoLogScope logScope( this );
+
+    //*** stop delivering log records to our signals ***
+    enableLogSignals( false );
+
     if ( udp_ )
     {
-        qDebug() << "[UDP] leaving multicast group";
-        udp_->leaveMulticastGroup( QHostAddress( FAUXMO_UDP_MULTICAST_IP ) );
+        FAUXMO_LOG( Discovery, Debug, "UDP", "leaving multicast group" );
+        foreach( auto sif, interfaces_ )
+            udp_->leaveMulticastGroup( QHostAddress( FAUXMO_UDP_MULTICAST_IP ), sif.netIF );
         delete udp_;
     }
 
-    //*** deletes all devices ***
+    //*** stop serving lights before the devices go ***
+    delete hueBridge_;
+
+    //*** joins the loop threads ***
+    delete epoll_;
+
+    //*** deletes all devices - removed ones too, while the pool they detach from exists ***
     qDeleteAll( nameToDevice_ );
+    foreach( auto dev, removedDevices_ )
+        delete dev.data();
 }
 
 
@@ -53,8 +121,34 @@ FauxMoQt::~FauxMoQt()
 //*****************************************************************************
 void FauxMoQt::initialize()
 {
+    FauxMoLogScope logScope( this );
+
     setupNetworkInterface();
 
+    //*** the Hue bridge is served by Qt sockets only ***
+    if ( epoll_ && ( emulationMode_ & HueMode ) )
+    {
+        FAUXMO_LOG( General, Warning, "", "Hue emulation needs the Qt engine, not using epoll" );
+        fallBackToQtEngine();
+    }
+
+    //*** native engine answers discovery and serves the device ports itself ***
+    if ( epoll_ )
+    {
+        QList<QNetworkInterface> netIFs;
+        foreach( auto sif, interfaces_ )
+            netIFs.append( sif.netIF );
+
+        if ( epoll_->start( netIFs, QHostAddress( FAUXMO_UDP_MULTICAST_IP ), FAUXMO_UDP_MULTICAST_PORT,
+                            connGuard_->limits() ) )
+            return;
+
+        FAUXMO_LOG( General, Error, "", "epoll engine failed to start, falling back to the Qt engine" );
+        fallBackToQtEngine();
+    }
+
+    if ( emulationMode_ & HueMode ) setupHueBridge();
+
     setupUDP();
 }
 
@@ -62,21 +156,114 @@ void FauxMoQt::initialize()
 //*****************************************************************************
 //*****************************************************************************
 /**
- * @brief FauxMoQt::setupNetworkInterface
+ * @brief FauxMoQt::fallBackToQtEngine - the epoll engine could not start or
+ *        can't serve the emulation mode, devices added so far open their
+ *        own ports instead
+ */
+//*****************************************************************************
+void FauxMoQt::fallBackToQtEngine()
+{
+    delete epoll_;
+    epoll_ = nullptr;
+
+    if ( !( emulationMode_ & WemoMode ) ) return;
+
+    foreach( auto dev, nameToDevice_.values() )
+    {
+        if ( dev->listen() ) continue;
+
+        //*** not advertised if it can't be reached ***
+        FAUXMO_LOG( Device, Error, dev->getName(), "Device removed" );
+        removeDevice( dev->getName() );
+    }
+}
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief FauxMoQt::enableDiscovery
+ * @param en
+ */
+//*****************************************************************************
+void FauxMoQt::enableDiscovery( bool en )
+{
+    discoveryEnabled_ = en;
+
+    if ( epoll_ ) epoll_->setDiscoveryEnabled( en );
+}
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief FauxMoQt::setEmulationMode
+ * @param mode
+ * @param huePort
+ */
+//*****************************************************************************
+void FauxMoQt::setEmulationMode( EmulationMode mode, quint16 huePort )
+{
+    emulationMode_ = mode;
+    huePort_ = huePort;
+}
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief FauxMoQt::setupHueBridge - one bridge serving every device as a
+ *        light, ids derived from the first interface's MAC. Without the
+ *        port there is no bridge, and the SSDP side stays Wemo only
+ */
+//*****************************************************************************
+void FauxMoQt::setupHueBridge()
+{
+    if ( hueBridge_ ) return;
+
+    QString mac;
+    if ( !interfaces_.isEmpty() ) mac = interfaces_.first().netIF.hardwareAddress();
+
+    hueBridge_ = new HueBridge( huePort_, mac, connGuard_, connPool_, watchdog_ );
+    if ( !hueBridge_->listen() )
+    {
+        delete hueBridge_;
+        hueBridge_ = nullptr;
+        return;
+    }
+
+    //*** sorted, so id collisions resolve the same way every start ***
+    QStringList names = nameToDevice_.keys();
+    names.sort();
+    foreach( auto name, names )
+        hueBridge_->addLight( nameToDevice_[name] );
+
+    //*** propagate signals ***
+    connect( hueBridge_, SIGNAL(setDeviceState(QString,bool)), SLOT(deviceStateChanged(QString,bool)) );
+}
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief FauxMoQt::setupNetworkInterface - finds every interface we answer
+ *        discovery on (all eligible ones, or those set with setInterfaces)
  * @return
  */
 //*****************************************************************************
 bool FauxMoQt::setupNetworkInterface()
 {
 QNetworkInterface::InterfaceFlags flags;
-bool isUp       = false;
-bool isRunning  = false;
-bool isLoopback = false;
+bool isUp         = false;
+bool isRunning    = false;
+bool isLoopback   = false;
+bool canMulticast = false;
+
+    FauxMoLogScope logScope( this );
 
     if ( haveInterface_ ) return true;
 
-    emit msgOut( "Setting up network interface" );
-    emit msgOut( "" );
+    FAUXMO_LOG( General, Info, "", "Setting up network interfaces" );
 
     //*** get list of interfaces ***
     QList<QNetworkInterface> ifs = QNetworkInterface::allInterfaces();
@@ -87,45 +274,45 @@ bool isLoopback = false;
         //*** get the flags for the interface ***
         flags = ni.flags();
 
-        isUp       = flags & QNetworkInterface::IsUp;
-        isRunning  = flags & QNetworkInterface::IsRunning;
-        isLoopback = flags & QNetworkInterface::IsLoopBack;
+        isUp         = flags & QNetworkInterface::IsUp;
+        isRunning    = flags & QNetworkInterface::IsRunning;
+        isLoopback   = flags & QNetworkInterface::IsLoopBack;
+        canMulticast = flags & QNetworkInterface::CanMulticast;
 
-        //*** look for one in use ***
-        if ( isUp && isRunning && !isLoopback )
-        {
-            haveInterface_ = true;      // we have a winner
-            netIF_ = ni;                // save the interface
+        bool isNamed = ifNames_.contains( ni.name() ) || ifNames_.contains( ni.humanReadableName() );
 
-            //*** get IPV4 address ***
-            QList<QNetworkAddressEntry> entries = ni.addressEntries();
-            foreach( auto entry, entries )
-            {
-                //*** we only want the IPV4 address ***
-                if ( entry.ip().protocol() == QAbstractSocket::IPv4Protocol )
-                {
-                    //*** save the IPV4 address ***
-                    localAddress_ = entry.ip();
-                }
-            }
+        //*** look for ones in use - loopback only if asked for (replay, no multicast needed) ***
+        if ( !isUp || !isRunning ) continue;
+        if ( isLoopback ? !isNamed : !canMulticast ) continue;
 
-            //*** mac address ***
-            macStr_ = netIF_.hardwareAddress().toLower().remove( ":" );
+        //*** restricted to a configured set ***
+        if ( !ifNames_.isEmpty() && !isNamed ) continue;
 
-            //*** create uuid using mac ***
-            QString msgTxt = QString("IF: %1  localIP: %2  mac: %3\n")
-                          .arg(netIF_.humanReadableName())
-                          .arg(localAddress_.toString())
-                          .arg( macStr_ );
-            emit msgOut( msgTxt );
-            emit msgOut( "" );
+        SsdpInterface sif;
+        sif.netIF = ni;
 
-            break;
+        //*** we only want the IPV4 addresses ***
+        QList<QNetworkAddressEntry> entries = ni.addressEntries();
+        foreach( auto entry, entries )
+        {
+            if ( entry.ip().protocol() == QAbstractSocket::IPv4Protocol )
+                sif.addrs.append( entry );
         }
+
+        if ( sif.addrs.isEmpty() ) continue;
+
+        interfaces_.append( sif );
+
+        FAUXMO_LOG( General, Info, "", "IF: %s  localIP: %s  mac: %s",
+                    qPrintable( ni.humanReadableName() ),
+                    qPrintable( sif.addrs.first().ip().toString() ),
+                    qPrintable( ni.hardwareAddress().toLower().remove( ":" ) ) );
     }
 
+    haveInterface_ = !interfaces_.isEmpty();
+
     if ( !haveInterface_ )
-        emit error( "No valid interface found" );
+        FAUXMO_LOG( General, Error, "", "No valid interface found" );
 
     return haveInterface_;
 }
@@ -140,6 +327,9 @@ bool isLoopback = false;
 void FauxMoQt::setupUDP()
 {
 bool ok = true;
+int joined = 0;
+
+    FauxMoLogScope logScope( this );
 
     //*** must have found a valid interface ***
     if ( haveInterface_ )
@@ -151,36 +341,88 @@ bool ok = true;
         QHostAddress multicastAddr( FAUXMO_UDP_MULTICAST_IP );
 
         //*** bind to a port ***
-        if ( !udp_->bind( QHostAddress::AnyIPv4, FAUXMO_UDP_MULTICAST_PORT, QUdpSocket::ShareAddress ) )
+        if ( !bindUDP() )
         {
             ok = false;
-            emit error( "[UDP] Error binding to port" );
+            FAUXMO_LOG( Discovery, Error, "UDP", "Error binding to port" );
         }
         else
         {
-            qDebug() << "[UDP] Bound to port";
+            FAUXMO_LOG( Discovery, Debug, "UDP", "Bound to port" );
         }
 
-        //*** set the interface to use ***
-        udp_->setMulticastInterface( netIF_ );
+        //*** join the multicast group on every interface ***
+        for ( int i = 0; ok && i < interfaces_.size(); i++ )
+        {
+            const QNetworkInterface &ni = interfaces_[i].netIF;
+
+            if ( udp_->joinMulticastGroup( multicastAddr, ni ) )
+            {
+                joined++;
+                FAUXMO_LOG( Discovery, Debug, "UDP", "Joined multicast group : %s",
+                            qPrintable( ni.humanReadableName() ) );
+            }
+            else
+            {
+                FAUXMO_LOG( Discovery, Error, "UDP", "Error joining multicast group : %s",
+                            qPrintable( ni.humanReadableName() ) );
+            }
+        }
 
-        //*** join the multicast group ***
-        if ( ok && !udp_->joinMulticastGroup( multicastAddr, netIF_ ) )
+        //*** connect to data packets received ***
+        if ( ok && joined > 0 )
         {
-            emit error( "[UDP] Error joining multicast group" );
-            ok = false;
+            connect( udp_, SIGNAL(readyRead()), SLOT(readPendingDatagrams()) );
         }
-        else
+    }
+}
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief FauxMoQt::bindUDP - in scale-out mode every worker binds the SSDP
+ *        port with SO_REUSEPORT, each still gets every multicast search
+ * @return
+ */
+//*****************************************************************************
+bool FauxMoQt::bindUDP()
+{
+#if defined(Q_OS_UNIX) && defined(SO_REUSEPORT)
+    if ( workerCount_ > 1 )
+    {
+        int one = 1;
+
+        int fd = ::socket( AF_INET, SOCK_DGRAM, 0 );
+        if ( fd < 0 ) return false;
+
+        ::setsockopt( fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one) );
+        ::setsockopt( fd, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one) );
+
+        sockaddr_in sa;
+        memset( &sa, 0, sizeof(sa) );
+        sa.sin_family      = AF_INET;
+        sa.sin_port        = htons( FAUXMO_UDP_MULTICAST_PORT );
+        sa.sin_addr.s_addr = htonl( INADDR_ANY );
+
+        if ( ::bind( fd, reinterpret_cast<sockaddr*>(&sa), sizeof(sa) ) < 0 )
         {
-            qDebug() << "[UDP] Joined multicast group : " << udp_->multicastInterface();
+            ::close( fd );
+            return false;
         }
 
-        //*** connect to data packets received ***
-        if ( ok )
+        //*** hand it to Qt ***
+        if ( !udp_->setSocketDescriptor( fd, QAbstractSocket::BoundState ) )
         {
-            connect( udp_, SIGNAL(readyRead()), SLOT(readPendingDatagrams()) );
+            ::close( fd );
+            return false;
         }
+
+        return true;
     }
+#endif
+
+    return udp_->bind( QHostAddress::AnyIPv4, FAUXMO_UDP_MULTICAST_PORT, QUdpSocket::ShareAddress );
 }
 
 
@@ -192,46 +434,52 @@ bool ok = true;
 //*****************************************************************************
 void FauxMoQt::readPendingDatagrams()
 {
-QHostAddress sender;
-quint16 senderPort = 0;
-QString pattern;
+    FauxMoLogScope logScope( this );
+
+    WatchdogScope watch( watchdog_, LoopWatchdog::Discovery );
 
     //*** process all datagrams ***
     while( udp_->hasPendingDatagrams() )
     {
-        //*** allocate buffer to hold the message ***
-        QByteArray datagram;
-        datagram.resize( udp_->pendingDatagramSize() );
+        //*** read the packet - also tells us which interface it came in on ***
+        QNetworkDatagram datagram = udp_->receiveDatagram();
+
+        QHostAddress sender  = datagram.senderAddress();
+        quint16 senderPort   = quint16( datagram.senderPort() );
 
-        //*** read the packet ***
-        udp_->readDatagram( datagram.data(), datagram.size(), &sender, &senderPort );
+        //*** trace id ties the responses to this search ***
+        FAUXMO_TRACE( trace, SsdpReceive, ( quint64(sender.toIPv4Address()) << 16 ) | senderPort );
 
-        //*** convert to a QString ***
-        QString data = datagram.data();
+        QByteArray data = datagram.data();
 
-        //*** determine if it's a message we want to respond to ***
-        if ( discoveryEnabled_ && data.contains( "M-SEARCH" ) )
+        //*** traffic capture for replay ***
+        if ( FauxMoCapture::enabled() )
+            FauxMoCapture::record( FauxMoCapture::Ssdp, sender.toIPv4Address(), senderPort, FAUXMO_UDP_MULTICAST_PORT,
+                                   data.constData(), data.size() );
+
+        if ( !discoveryEnabled_ ) continue;
+
+        //*** determine if it's a search we want to respond to ***
+        SsdpTarget target = FauxMoProtocol::classifySearch( data.constData(), data.size() );
+        if ( target == SsdpNone ) continue;
+
+        //*** answer with the address of the interface the search came in on ***
+        QHostAddress local = localAddressFor( datagram.interfaceIndex(), sender );
+        if ( local.isNull() ) continue;
+
+        //*** send response for each device - basic:1 is for the Hue bridge only ***
+        if ( ( emulationMode_ & WemoMode ) && target != SsdpHue )
         {
-            //*** check for any valid pattern ***
-            foreach( auto p, patterns_ )
+            foreach( auto device, nameToDevice_ )
             {
-                if ( data.contains( p ) )
-                {
-                    pattern = p;
-                    break;
-                }
+                sendUDPResponse( sender, senderPort, local, device, target );
             }
+        }
 
-            //*** if pattern was found ***
-            if ( !pattern.isNull() )
-            {
-                //*** send response for each device ***
-                QStringList devices = nameToDevice_.keys();
-                foreach( auto d, devices )
-                {
-                    sendUDPResponse( sender, senderPort, d, pattern );
-                }
-            }
+        //*** one response for the bridge, not one per light ***
+        if ( hueBridge_ && target != SsdpWemo )
+        {
+            sendHueResponse( sender, senderPort, local );
         }
     }
 }
@@ -240,43 +488,93 @@ QString pattern;
 //*****************************************************************************
 //*****************************************************************************
 /**
- * @brief FauxMoQt::sendUDPResponse
+ * @brief FauxMoQt::localAddressFor - picks the address to advertise
+ * @param ifIndex - interface the datagram arrived on, 0 if unknown
+ * @param sender - prefer an address on the sender's subnet
+ * @return - null if the interface is not one of ours
  */
 //*****************************************************************************
-void FauxMoQt::sendUDPResponse( QHostAddress &addr, quint16 portIn, QString devName, QString pattern )
+QHostAddress FauxMoQt::localAddressFor( int ifIndex, const QHostAddress &sender ) const
 {
-QString response;
+    foreach( auto sif, interfaces_ )
+    {
+        if ( ifIndex && sif.netIF.index() != ifIndex ) continue;
+
+        foreach( auto entry, sif.addrs )
+        {
+            if ( sender.isInSubnet( entry.ip(), entry.prefixLength() ) )
+                return entry.ip();
+        }
 
+        //*** arrived on this interface but not from a local subnet ***
+        if ( ifIndex ) return sif.addrs.first().ip();
+    }
+
+    //*** unknown interface index - fall back to the first interface ***
+    if ( !ifIndex && !interfaces_.isEmpty() ) return interfaces_.first().addrs.first().ip();
+
+    return QHostAddress();
+}
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief FauxMoQt::sendUDPResponse - sends a pre-rendered response, only the
+ *        date is filled in per send
+ * @param addr - where to send
+ * @param portIn
+ * @param local - our address to advertise in LOCATION
+ * @param device
+ * @param target - matched search target
+ */
+//*****************************************************************************
+void FauxMoQt::sendUDPResponse( const QHostAddress &addr, quint16 portIn, const QHostAddress &local,
+                                WemoDevice *device, SsdpTarget target )
+{
     //*** must have ethernet info ***
     if ( !haveInterface_ ) return;
 
-    //*** get pointer to device ***
-    WemoDevice* device = nameToDevice_[devName];
+    FAUXMO_TRACE( trace, SsdpResponse, ( quint64(addr.toIPv4Address()) << 16 ) | portIn );
 
-    //*** get port for this device ***
-    quint16 myPort = device->getPort();
+    //*** rendered once per interface address and device ***
+    QVector<QByteArray> &rendered = responseCache_[local.toIPv4Address()][device];
+    if ( rendered.isEmpty() )
+    {
+        QString location = local.toString() + ":" + QString::number( device->getPort() );
+        FauxMoProtocol::renderSearchResponses( location, device->getUuid(), responseHead_, rendered );
+    }
 
-    QString uuid = device->getUuid();
+    //*** assemble and send the response ***
+    FauxMoProtocol::assembleSearchResponse( udpOut_, responseHead_, rendered.at( target ) );
+
+    udp_->writeDatagram( udpOut_, addr, portIn );
+}
 
-    QString pattern2 = pattern.remove( "ST: " );
 
-    //*** location of setup file ***
-    QString point = localAddress_.toString() + ":" + QString::number( myPort );
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief FauxMoQt::sendHueResponse - bridge discovery response, rendered once
+ *        per interface address
+ * @param addr - where to send
+ * @param portIn
+ * @param local - our address to advertise in LOCATION
+ */
+//*****************************************************************************
+void FauxMoQt::sendHueResponse( const QHostAddress &addr, quint16 portIn, const QHostAddress &local )
+{
+    if ( !haveInterface_ ) return;
 
-    //*** create the response ***
-    response = QString(UDP_RESPONSE_TEMPLATE)
-            .arg(timeStr()).arg(point).arg(uuid).arg(pattern).arg(pattern2);
+    FAUXMO_TRACE( trace, SsdpResponse, ( quint64(addr.toIPv4Address()) << 16 ) | portIn );
 
-    //*** convert to utf8 ***
-    QByteArray inUtf8 = response.toUtf8();
-    const char *responseUtf8 = inUtf8.constData();
+    QByteArray &response = hueResponseCache_[local.toIPv4Address()];
+    if ( response.isEmpty() ) response = hueBridge_->ssdpResponse( local );
 
-    //*** send the response ***
-    udp_->writeDatagram( responseUtf8, strlen(responseUtf8), addr, portIn );
+    udp_->writeDatagram( response, addr, portIn );
 }
 
 
-
 //*****************************************************************************
 //*****************************************************************************
 /**
@@ -286,38 +584,770 @@ QString response;
 //*****************************************************************************
 void FauxMoQt::addDevice( QString devName )
 {
+    createDevice( devName, QString(), 0 );
+}
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief FauxMoQt::addGroup
+ * @param groupName
+ * @param members
+ * @return
+ */
+//*****************************************************************************
+bool FauxMoQt::addGroup( QString groupName, QStringList members )
+{
+    if ( nameToDevice_.contains( groupName ) ) return false;
+
+    members.removeAll( groupName );
+    members.removeDuplicates();
+
+    groups_[groupName] = members;
+    if ( epoll_ ) epoll_->setGroups( groups_ );
+
+    if ( !createDevice( groupName, QString(), 0 ) )
+    {
+        groups_.remove( groupName );
+        if ( epoll_ ) epoll_->setGroups( groups_ );
+        return false;
+    }
+
+    return true;
+}
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief FauxMoQt::createDevice
+ * @param devName
+ * @param uuid - empty to generate one
+ * @param port - 0 to allocate one
+ * @return - new device, nullptr if not created
+ */
+//*****************************************************************************
+WemoDevice *FauxMoQt::createDevice( QString devName, QString uuid, quint16 port )
+{
+    FauxMoLogScope logScope( this );
+
     //*** check if already exists ***
-    if ( nameToDevice_.contains( devName ) ) return;
+    if ( nameToDevice_.contains( devName ) ) return nullptr;
+
+    //*** another worker serves this one ***
+    if ( !ownsDevice( devName ) ) return nullptr;
+
+    //*** explicit ports must not collide with other devices - automatic ones
+    //*** skip them, but other workers can't see ours ***
+    bool autoPort = ( port == 0 );
+    if ( !autoPort && ( emulationMode_ & WemoMode ) )
+    {
+        if ( workerCount_ > 1 )
+        {
+            quint32 blocksEnd = BASE_TCP_PORT + quint32(workerCount_) * ( lastTcpPort_ - firstTcpPort_ + 1 ) - 1;
+
+            if ( port >= BASE_TCP_PORT && port <= blocksEnd )
+            {
+                FAUXMO_LOG( Device, Error, devName, "TCP port %u is in the worker port blocks %u-%u",
+                            unsigned(port), unsigned(BASE_TCP_PORT), unsigned(blocksEnd) );
+                return nullptr;
+            }
+        }
+
+        foreach( auto dev, nameToDevice_ )
+        {
+            if ( dev->getPort() != port ) continue;
+
+            FAUXMO_LOG( Device, Error, devName, "TCP port %u is used by %s", unsigned(port), qPrintable( dev->getName() ) );
+            return nullptr;
+        }
+
+        if ( hueBridge_ && port == huePort_ )
+        {
+            FAUXMO_LOG( Device, Error, devName, "TCP port %u is used by the Hue bridge", unsigned(port) );
+            return nullptr;
+        }
+    }
+
+    //*** reuse a freed port, else the next one in our block, skipping ports
+    //*** explicit devices hold - lights need none ***
+    while ( port == 0 && ( emulationMode_ & WemoMode ) )
+    {
+        quint16 candidate;
+
+        if ( !freePorts_.isEmpty() )
+        {
+            candidate = freePorts_.takeFirst();
+        }
+        else if ( nextTcpPort_ <= lastTcpPort_ )
+        {
+            candidate = quint16( nextTcpPort_++ );
+        }
+        else
+        {
+            FAUXMO_LOG( Device, Error, devName, "No TCP port left in this worker's block" );
+            return nullptr;
+        }
+
+        if ( !portInUse( candidate ) ) port = candidate;
+    }
 
     //*** create a new object ***
-    WemoDevice* newDev = new WemoDevice( devName, nextTcpPort_++, this );
+    WemoDevice* newDev = new WemoDevice( devName, port, connGuard_, connPool_, watchdog_, this );
+    if ( !uuid.isEmpty() ) newDev->setUuid( uuid );
+
+    //*** Wemo switches serve their own port - or the epoll loops serve it ***
+    if ( emulationMode_ & WemoMode )
+    {
+        bool listening = epoll_ ? epoll_->addDevice( devName, newDev->getUuid(), port, newDev->getState() )
+                                : newDev->listen();
+
+        if ( !listening )
+        {
+            //*** not advertised if it can't be reached ***
+            FAUXMO_LOG( Device, Error, devName, "Device not added" );
+            if ( autoPort ) freePorts_.append( port );
+            delete newDev;
+            return nullptr;
+        }
+    }
+
     nameToDevice_[devName] = newDev;
 
+    if ( hueBridge_ ) hueBridge_->addLight( newDev );
+
+    //*** shared memory entry ***
+    exportDevice( newDev );
+
     //*** propagate signals ***
-    connect( newDev, SIGNAL(setDeviceState(QString,bool)), SIGNAL(setDeviceState(QString,bool)) );
+    connect( newDev, SIGNAL(setDeviceState(QString,bool)), SLOT(deviceStateChanged(QString,bool)) );
 
-    connect( newDev, SIGNAL(error(QString)),  SIGNAL(error(QString))  );
-    connect( newDev, SIGNAL(msgOut(QString)), SIGNAL(msgOut(QString)) );
+    return newDev;
 }
 
 
 //*****************************************************************************
 //*****************************************************************************
 /**
- * @brief setState
- * @param devName
- * @param state
+ * @brief FauxMoQt::portInUse - held by a device or the Hue bridge
+ * @param port
  * @return
  */
 //*****************************************************************************
-bool FauxMoQt::setState( QString devName, bool state )
+bool FauxMoQt::portInUse( quint16 port ) const
 {
-    if ( nameToDevice_.contains( devName ) )
+    if ( hueBridge_ && port == huePort_ ) return true;
+
+    foreach( auto dev, nameToDevice_ )
     {
-        nameToDevice_[devName]->setCurrentState( state );
-        return true;
+        if ( dev->getPort() == port ) return true;
     }
 
     return false;
 }
 
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief FauxMoQt::removeDevice - announces byebye, stops listening and
+ *        deletes the device once connections in progress are done with it
+ * @param devName
+ * @return
+ */
+//*****************************************************************************
+bool FauxMoQt::removeDevice( QString devName )
+{
+    WemoDevice *dev = nameToDevice_.take( devName );
+    if ( !dev ) return false;
+
+    sendByeBye( dev );
+
+    if ( hueBridge_ ) hueBridge_->removeLight( dev );
+
+    if ( epoll_ ) epoll_->removeDevice( devName );
+
+    //*** drop it as a group and as a member ***
+    groups_.remove( devName );
+    for ( auto it = groups_.begin(); it != groups_.end(); ++it )
+        it.value().removeAll( devName );
+
+    if ( epoll_ ) epoll_->setGroups( groups_ );
+
+    //*** no more signals from it, free the port now ***
+    disconnect( dev, nullptr, this, nullptr );
+    dev->shutdown();
+
+    //*** free its shared memory entry ***
+    stateExport_.removeDevice( dev->exportSlot() );
+    dev->setStateExport( nullptr, -1 );
+
+    //*** handed out already - an explicit port skipped by the allocator is too ***
+    if ( dev->getPort() >= firstTcpPort_ && dev->getPort() < nextTcpPort_ && !freePorts_.contains( dev->getPort() ) )
+        freePorts_.append( dev->getPort() );
+
+    invalidateResponses( dev );
+
+    //*** may be called from one of its own signals - not a child any more, so
+    //*** if we go first the destructor deletes it before connPool_ goes ***
+    dev->setParent( nullptr );
+    removedDevices_.removeAll( nullptr );
+    removedDevices_.append( dev );
+    dev->deleteLater();
+
+    return true;
+}
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief FauxMoQt::renameDevice - keeps uuid, port and open connections
+ * @param oldName
+ * @param newName
+ * @return
+ */
+//*****************************************************************************
+bool FauxMoQt::renameDevice( QString oldName, QString newName )
+{
+    if ( !nameToDevice_.contains( oldName ) || nameToDevice_.contains( newName ) ) return false;
+
+    //*** in scale-out mode the new name may belong to another worker ***
+    if ( !ownsDevice( newName ) ) return removeDevice( oldName );
+
+    WemoDevice *dev = nameToDevice_.take( oldName );
+    dev->setName( newName );
+    nameToDevice_[newName] = dev;
+
+    if ( epoll_ ) epoll_->renameDevice( oldName, newName );
+
+    stateExport_.renameDevice( dev->exportSlot(), newName );
+
+    //*** groups refer to devices by name ***
+    if ( groups_.contains( oldName ) ) groups_[newName] = groups_.take( oldName );
+    for ( auto it = groups_.begin(); it != groups_.end(); ++it )
+    {
+        int idx = it.value().indexOf( oldName );
+        if ( idx >= 0 ) it.value()[idx] = newName;
+    }
+
+    if ( epoll_ ) epoll_->setGroups( groups_ );
+
+    invalidateResponses( dev );
+
+    return true;
+}
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief FauxMoQt::invalidateResponses - drops pre-rendered discovery responses
+ * @param dev
+ */
+//*****************************************************************************
+void FauxMoQt::invalidateResponses( WemoDevice *dev )
+{
+    for ( auto it = responseCache_.begin(); it != responseCache_.end(); ++it )
+        it.value().remove( dev );
+}
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief FauxMoQt::sendByeBye - tells controllers on every interface that
+ *        the device is gone
+ * @param dev
+ */
+//*****************************************************************************
+void FauxMoQt::sendByeBye( WemoDevice *dev )
+{
+QStringList types;
+
+    if ( !discoveryEnabled_ || !( emulationMode_ & WemoMode ) ) return;
+
+    types << "urn:Belkin:device:controllee:1";
+    types << "upnp:rootdevice";
+
+    //*** the epoll engine sends from its discovery socket ***
+    if ( epoll_ )
+    {
+        foreach( auto nt, types )
+            epoll_->sendMulticast( QString( UDP_BYEBYE_TEMPLATE ).arg( nt ).arg( dev->getUuid() ).toUtf8() );
+        return;
+    }
+
+    if ( !udp_ ) return;
+
+    QHostAddress group( FAUXMO_UDP_MULTICAST_IP );
+
+    foreach( auto sif, interfaces_ )
+    {
+        udp_->setMulticastInterface( sif.netIF );
+
+        foreach( auto nt, types )
+        {
+            QByteArray msg = QString( UDP_BYEBYE_TEMPLATE ).arg( nt ).arg( dev->getUuid() ).toUtf8();
+            udp_->writeDatagram( msg, group, FAUXMO_UDP_MULTICAST_PORT );
+        }
+    }
+}
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief FauxMoQt::loadConfig
+ * @param fileName
+ * @param watch
+ * @return
+ */
+//*****************************************************************************
+bool FauxMoQt::loadConfig( QString fileName, bool watch )
+{
+    configFile_ = fileName;
+
+    if ( watch )
+    {
+        if ( !configWatcher_ )
+        {
+            configWatcher_ = new QFileSystemWatcher( this );
+            connect( configWatcher_, SIGNAL(fileChanged(QString)), &configReload_, SLOT(start()) );
+        }
+
+        configWatcher_->addPath( fileName );
+    }
+
+    return applyConfig();
+}
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief FauxMoQt::applyConfig - applies the difference between the config
+ *        file and the devices it created last time
+ * @return - false if the file could not be read (devices left unchanged)
+ */
+//*****************************************************************************
+bool FauxMoQt::applyConfig()
+{
+QHash<QString,ConfigEntry> wanted;
+int added   = 0;
+int removed = 0;
+int renamed = 0;
+
+    FauxMoLogScope logScope( this );
+
+    //*** editors often replace the file - keep watching the new one ***
+    if ( configWatcher_ && !configWatcher_->files().contains( configFile_ ) && QFile::exists( configFile_ ) )
+        configWatcher_->addPath( configFile_ );
+
+    if ( !parseConfig( configFile_, wanted ) ) return false;
+
+    //*** gone, or uuid/port changed - those need a new device ***
+    QStringList ids = configDevices_.keys();
+    foreach( auto id, ids )
+    {
+        const ConfigEntry cur = configDevices_.value( id );
+        auto it = wanted.constFind( id );
+
+        if ( it == wanted.constEnd() || it.value().uuid != cur.uuid || it.value().port != cur.port )
+        {
+            removeDevice( cur.name );
+            configDevices_.remove( id );
+            removed++;
+        }
+    }
+
+    //*** renamed ***
+    for ( auto cur = configDevices_.begin(); cur != configDevices_.end(); )
+    {
+        const ConfigEntry &want = wanted[cur.key()];
+
+        if ( want.name == cur.value().name )
+        {
+            ++cur;
+            continue;
+        }
+
+        if ( !renameDevice( cur.value().name, want.name ) )
+        {
+            FAUXMO_LOG( Device, Warning, cur.value().name, "Can't rename to %s", qPrintable( want.name ) );
+            ++cur;
+            continue;
+        }
+
+        renamed++;
+
+        //*** still ours - unless renamed into another worker's partition ***
+        if ( nameToDevice_.contains( want.name ) )
+        {
+            cur.value().name = want.name;
+            ++cur;
+        }
+        else
+        {
+            cur = configDevices_.erase( cur );
+        }
+    }
+
+    //*** new ***
+    for ( auto it = wanted.constBegin(); it != wanted.constEnd(); ++it )
+    {
+        if ( configDevices_.contains( it.key() ) ) continue;
+
+        if ( createDevice( it.value().name, it.value().uuid, it.value().port ) )
+        {
+            configDevices_.insert( it.key(), it.value() );
+            added++;
+        }
+    }
+
+    if ( added || removed || renamed )
+    {
+        FAUXMO_LOG( General, Info, "", "Config applied: %d added, %d removed, %d renamed",
+                    added, removed, renamed );
+    }
+
+    emit configApplied( added, removed, renamed );
+
+    return true;
+}
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief FauxMoQt::parseConfig - reads the device list. Either an array or
+ *        an object with a "devices" array. Each entry is a name or an object:
+ *        { "id": stable key (defaults to name), "name": friendly name,
+ *          "uuid": fixed uuid (optional), "port": fixed TCP port (optional) }
+ * @param fileName
+ * @param wanted - receives entries by id
+ * @return
+ */
+//*****************************************************************************
+bool FauxMoQt::parseConfig( QString fileName, QHash<QString,ConfigEntry> &wanted )
+{
+QJsonParseError err;
+
+    QFile file( fileName );
+    if ( !file.open( QIODevice::ReadOnly ) )
+    {
+        FAUXMO_LOG( General, Error, "", "Can't open config %s", qPrintable( fileName ) );
+        return false;
+    }
+
+    QJsonDocument doc = QJsonDocument::fromJson( file.readAll(), &err );
+    if ( err.error != QJsonParseError::NoError )
+    {
+        FAUXMO_LOG( General, Error, "", "Config %s: %s", qPrintable( fileName ),
+                    qPrintable( err.errorString() ) );
+        return false;
+    }
+
+    QJsonArray devices = doc.isArray() ? doc.array() : doc.object().value( "devices" ).toArray();
+
+    foreach( auto v, devices )
+    {
+        ConfigEntry entry;
+        QString id;
+
+        if ( v.isString() )
+        {
+            entry.name = v.toString();
+        }
+        else
+        {
+            QJsonObject obj = v.toObject();
+            id         = obj.value( "id" ).toString();
+            entry.name = obj.value( "name" ).toString();
+            entry.uuid = obj.value( "uuid" ).toString();
+
+            //*** optional - anything but a valid port drops the entry ***
+            if ( obj.contains( "port" ) )
+            {
+                int port = obj.value( "port" ).toInt( -1 );
+                if ( port < 1 || port > 65535 )
+                {
+                    FAUXMO_LOG( General, Error, entry.name, "Config %s: invalid port", qPrintable( fileName ) );
+                    continue;
+                }
+
+                entry.port = quint16( port );
+            }
+        }
+
+        if ( entry.name.isEmpty() ) continue;
+        if ( id.isEmpty() ) id = entry.name;
+
+        wanted.insert( id, entry );
+    }
+
+    return true;
+}
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief setState
+ * @param devName
+ * @param state
+ * @return
+ */
+//*****************************************************************************
+bool FauxMoQt::setState( QString devName, bool state )
+{
+    if ( nameToDevice_.contains( devName ) )
+    {
+        nameToDevice_[devName]->setCurrentState( state );
+        if ( epoll_ ) epoll_->setState( devName, state );
+        return true;
+    }
+
+    return false;
+}
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief FauxMoQt::deviceStateChanged - runs inside the device's request, so
+ *        all members are switched before the controller gets its response
+ * @param devName
+ * @param state
+ */
+//*****************************************************************************
+void FauxMoQt::deviceStateChanged( QString devName, bool state )
+{
+    FauxMoLogScope logScope( this );
+
+    if ( !groups_.contains( devName ) )
+    {
+        emit setDeviceState( devName, state );
+        return;
+    }
+
+    const QStringList &members = groups_[devName];
+
+    //*** keep GetBinaryState polls on the members consistent - the epoll loop
+    //*** switched them already, mirror what it serves ***
+    foreach( auto member, members )
+    {
+        WemoDevice *dev = nameToDevice_.value( member );
+        if ( dev ) dev->setCurrentState( epoll_ ? epoll_->state( member ) : state );
+    }
+
+    FAUXMO_LOG( Device, Info, devName, "Group set to %s (%d members)", state ? "on" : "off", members.size() );
+
+    emit setGroupState( devName, members, state );
+}
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief FauxMoQt::epollStateSet - the loop already switched the device (and
+ *        a group's members) and answered. Mirror what it serves into the
+ *        devices (shared memory table) - a newer setState may have replaced
+ *        the queued value - and let the app handle the request.
+ * @param devName
+ * @param state - as set by the controller
+ */
+//*****************************************************************************
+void FauxMoQt::epollStateSet( QString devName, bool state )
+{
+    FauxMoLogScope logScope( this );
+
+    //*** removed or renamed while the signal was queued ***
+    WemoDevice *dev = nameToDevice_.value( devName );
+    if ( !dev || !epoll_ ) return;
+
+    FAUXMO_LOG( Device, Debug, devName, "SetBinaryState" );
+
+    dev->setCurrentState( epoll_->state( devName ) );
+
+    WatchdogScope watch( watchdog_, LoopWatchdog::AppHandler );
+    deviceStateChanged( devName, state );
+}
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief FauxMoQt::enableLogSignals - installs/removes the msgOut/error log sink
+ * @param en
+ */
+//*****************************************************************************
+void FauxMoQt::enableLogSignals( bool en )
+{
+    if ( en == logSignals_ ) return;
+
+    logSignals_ = en;
+
+    if ( en )
+        FauxMoLog::addSink( this, [this]( const LogRecord &rec ) { logToSignals( rec ); }, true );
+    else
+        FauxMoLog::removeSinks( this );
+}
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief FauxMoQt::logToSignals - log sink, runs on the log thread with the
+ *        sink lock held, so the signals are emitted from this object's thread
+ * @param rec
+ */
+//*****************************************************************************
+void FauxMoQt::logToSignals( const LogRecord &rec )
+{
+QString msg     = QString::fromUtf8( rec.text );
+bool    isError = rec.level >= FauxMoLog::Warning;
+
+    if ( rec.subject[0] )
+        msg = "[" + QString::fromUtf8( rec.subject ) + "] " + msg;
+
+    //*** a slot that logs, or blocks on the log, can't deadlock the sink ***
+    QMetaObject::invokeMethod( this, [this, msg, isError]()
+    {
+        if ( isError )
+            emit error( msg );
+        else
+            emit msgOut( msg );
+    }, Qt::QueuedConnection );
+}
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief FauxMoQt::setWorker
+ * @param index
+ * @param count
+ * @param portBlock
+ * @return
+ */
+//*****************************************************************************
+bool FauxMoQt::setWorker( int index, int count, quint16 portBlock )
+{
+    FauxMoLogScope logScope( this );
+
+    //*** partition must be set before devices are created ***
+    if ( !nameToDevice_.isEmpty() )
+    {
+        FAUXMO_LOG( General, Error, "", "setWorker called after devices were added" );
+        return false;
+    }
+
+    quint32 first = quint32(BASE_TCP_PORT) + quint32(index) * portBlock;
+
+    if ( count < 1 || index < 0 || index >= count || portBlock == 0 || first + portBlock - 1 > 65535 )
+    {
+        FAUXMO_LOG( General, Error, "", "Invalid worker %d of %d", index, count );
+        return false;
+    }
+
+    workerIndex_ = index;
+    workerCount_ = count;
+
+    //*** our block of TCP ports ***
+    nextTcpPort_ = first;
+    firstTcpPort_ = first;
+    lastTcpPort_ = first + portBlock - 1;
+
+    FAUXMO_LOG( General, Info, "", "Worker %d of %d, TCP ports %u-%u",
+                index, count, unsigned(first), unsigned(lastTcpPort_) );
+
+    return true;
+}
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief FauxMoQt::ownsDevice
+ * @param devName
+ * @return
+ */
+//*****************************************************************************
+bool FauxMoQt::ownsDevice( QString devName ) const
+{
+    return workerCount_ <= 1 || workerFor( devName, workerCount_ ) == workerIndex_;
+}
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief FauxMoQt::workerFor - FNV-1a of the UTF-8 name, qHash is seeded per
+ *        process so it can't be used here
+ * @param devName
+ * @param count
+ * @return
+ */
+//*****************************************************************************
+int FauxMoQt::workerFor( QString devName, int count )
+{
+quint32 hash = 2166136261u;
+
+    if ( count <= 1 ) return 0;
+
+    QByteArray name = devName.toUtf8();
+    for ( int i = 0; i < name.size(); i++ )
+    {
+        hash ^= quint8( name[i] );
+        hash *= 16777619u;
+    }
+
+    return int( hash % quint32(count) );
+}
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief FauxMoQt::enableStateExport
+ * @param shmName
+ * @param capacity
+ * @param replaceStale
+ * @return
+ */
+//*****************************************************************************
+bool FauxMoQt::enableStateExport( QString shmName, int capacity, bool replaceStale )
+{
+    FauxMoLogScope logScope( this );
+
+    //*** one table per worker ***
+    if ( workerCount_ > 1 ) shmName += QString( "-%1" ).arg( workerIndex_ );
+
+    if ( !stateExport_.open( shmName, capacity, replaceStale ) ) return false;
+
+    //*** devices added before now ***
+    foreach( auto dev, nameToDevice_ )
+        exportDevice( dev );
+
+    FAUXMO_LOG( General, Info, "", "Exporting device state to %s", qPrintable( shmName ) );
+
+    return true;
+}
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief FauxMoQt::exportDevice - gives a device an entry in the state table
+ * @param dev
+ */
+//*****************************************************************************
+void FauxMoQt::exportDevice( WemoDevice *dev )
+{
+    if ( !stateExport_.isOpen() ) return;
+
+    int slot = stateExport_.addDevice( dev->getName(), dev->getState() );
+    if ( slot >= 0 ) dev->setStateExport( &stateExport_, slot );
+}
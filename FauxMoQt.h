@@ -14,6 +14,18 @@
 #include <QHostAddress>
 
 #include "WemoDevice.h"
+#include "HueBridge.h"
+#include "ConnectionGuard.h"
+#include "ConnectionPool.h"
+#include "FauxMoLog.h"
+#include "FauxMoTrace.h"
+#include "FauxMoCapture.h"
+#include "FauxMoReplay.h"
+#include "FauxMoSoak.h"
+#include "LoopWatchdog.h"
+#include "StateExport.h"
+#include "FauxMoProtocol.h"
+#include "FauxMoEpoll.h"
 
 #include "FauxMo_Templates.h"
 
@@ -22,6 +34,15 @@ const quint16 FAUXMO_UDP_MULTICAST_PORT = 1900;
 
 const quint16 BASE_TCP_PORT             = 19125;
 
+//*** TCP ports reserved for each worker process in scale-out mode ***
+const quint16 DEFAULT_PORT_BLOCK        = 1000;
+
+//*** settle time after the config file changes ***
+const int CONFIG_RELOAD_DELAY_MS        = 200;
+
+//*** Hue clients expect the bridge on port 80 ***
+const quint16 HUE_BRIDGE_PORT           = 80;
+
 
 class FAUXMOLIB_EXPORT FauxMoQt : public QObject
 {
@@ -30,13 +51,30 @@ class FAUXMOLIB_EXPORT FauxMoQt : public QObject
 
 public:
 
+    //*** what the devices are presented as ***
+    enum EmulationMode
+    {
+        WemoMode        = 0x1,      // one Wemo switch per device
+        HueMode         = 0x2,      // all devices as lights behind one Hue bridge
+        WemoAndHueMode  = 0x3
+    };
+
+    //*** what serves discovery and the device ports ***
+    enum Engine
+    {
+        QtEventLoop,                // Qt sockets on the caller's event loop
+        EpollEventLoop              // native epoll loops on their own threads (Linux)
+    };
+
     //*****************************************************************************
     //*****************************************************************************
     /**
      * @brief FauxMo - constructor
+     * @param engine - QtEventLoop, or EpollEventLoop for the native Linux engine
+     * @param loops - epoll loops (threads), <= 0 for one per core
      */
     //*****************************************************************************
-    FauxMoQt();
+    explicit FauxMoQt( Engine engine = QtEventLoop, int loops = 0 );
 
     //*****************************************************************************
     //*****************************************************************************
@@ -54,6 +92,16 @@ public:
     //*****************************************************************************
     void initialize();
 
+    //*****************************************************************************
+    //*****************************************************************************
+    /**
+     * @brief engine - what is serving, QtEventLoop if the epoll engine was
+     *        asked for but could not start
+     * @return
+     */
+    //*****************************************************************************
+    Engine engine() const { return epoll_ ? EpollEventLoop : QtEventLoop; }
+
     //*****************************************************************************
     //*****************************************************************************
     /**
@@ -64,6 +112,68 @@ public:
     //*****************************************************************************
     void addDevice( QString devName );
 
+    //*****************************************************************************
+    //*****************************************************************************
+    /**
+     * @brief addGroup - advertises a device that switches all its members at
+     *        once: member states are updated and the app gets one
+     *        setGroupState instead of a setDeviceState per member
+     * @param groupName
+     * @param members - device names, ones not served here are passed through
+     * @return - false if the name is in use or another worker serves it
+     */
+    //*****************************************************************************
+    bool addGroup( QString groupName, QStringList members );
+
+    //*****************************************************************************
+    //*****************************************************************************
+    /**
+     * @brief removeDevice - sends byebye and stops serving the device
+     * @param devName
+     * @return - false if not found
+     */
+    //*****************************************************************************
+    bool removeDevice( QString devName );
+
+    //*****************************************************************************
+    //*****************************************************************************
+    /**
+     * @brief renameDevice - keeps uuid, port and open connections
+     * @param oldName
+     * @param newName
+     * @return - false if not found or new name in use
+     */
+    //*****************************************************************************
+    bool renameDevice( QString oldName, QString newName );
+
+    //*****************************************************************************
+    //*****************************************************************************
+    /**
+     * @brief loadConfig - creates devices from a JSON file, optionally watching
+     *        it and applying only what changed on every edit
+     * @param fileName
+     * @param watch
+     * @return - false if the file could not be read
+     */
+    //*****************************************************************************
+    bool loadConfig( QString fileName, bool watch = true );
+
+    //*****************************************************************************
+    //*****************************************************************************
+    /**
+     * @brief enableStateExport - publish device states in a POSIX shared memory
+     *        table (layout in FauxMoShm.h) for other local processes. In
+     *        scale-out mode the worker index is appended ("/fauxmo-state-2")
+     *        so workers don't share a table - call setWorker first.
+     * @param shmName
+     * @param capacity - max devices in the table
+     * @param replaceStale - take over a table of the same name left by a
+     *        crashed run, otherwise an existing name is an error
+     * @return
+     */
+    //*****************************************************************************
+    bool enableStateExport( QString shmName = "/fauxmo-state", int capacity = 1024, bool replaceStale = false );
+
     //*****************************************************************************
     //*****************************************************************************
     /**
@@ -71,7 +181,66 @@ public:
      * @param en
      */
     //*****************************************************************************
-    void enableDiscovery( bool en ) { discoveryEnabled_ = en; }
+    void enableDiscovery( bool en );
+
+    //*****************************************************************************
+    //*****************************************************************************
+    /**
+     * @brief setInterfaces - limit discovery to these interfaces (name or
+     *        human readable name), empty for all eligible - call before initialize.
+     *        Loopback is only used when named, for offline replay.
+     * @param names
+     */
+    //*****************************************************************************
+    void setInterfaces( QStringList names ) { ifNames_ = names; }
+
+    //*****************************************************************************
+    //*****************************************************************************
+    /**
+     * @brief setEmulationMode - Wemo switches (default), one Hue bridge or
+     *        both - call before addDevice/initialize
+     * @param mode
+     * @param huePort - TCP port of the Hue bridge
+     */
+    //*****************************************************************************
+    void setEmulationMode( EmulationMode mode, quint16 huePort = HUE_BRIDGE_PORT );
+
+    //*****************************************************************************
+    //*****************************************************************************
+    /**
+     * @brief setWorker - scale-out mode, this process is worker 'index' of
+     *        'count'. Every worker may be given the full device list -
+     *        addDevice keeps only the devices whose name hashes to this worker,
+     *        TCP ports come from this worker's block and discovery is answered
+     *        only for those devices. Call before addDevice/initialize.
+     * @param index - 0 .. count-1
+     * @param count - number of worker processes
+     * @param portBlock - TCP ports reserved per worker
+     * @return - false if the settings are invalid or devices were already added
+     */
+    //*****************************************************************************
+    bool setWorker( int index, int count, quint16 portBlock = DEFAULT_PORT_BLOCK );
+
+    //*****************************************************************************
+    //*****************************************************************************
+    /**
+     * @brief ownsDevice - true if the device belongs to this worker
+     * @param devName
+     * @return
+     */
+    //*****************************************************************************
+    bool ownsDevice( QString devName ) const;
+
+    //*****************************************************************************
+    //*****************************************************************************
+    /**
+     * @brief workerFor - worker a device name hashes to (same in every process)
+     * @param devName
+     * @param count - number of workers
+     * @return
+     */
+    //*****************************************************************************
+    static int workerFor( QString devName, int count );
 
     //*****************************************************************************
     //*****************************************************************************
@@ -84,14 +253,140 @@ public:
     //*****************************************************************************
     bool setState( QString devName, bool state );
 
+    //*****************************************************************************
+    //*****************************************************************************
+    /**
+     * @brief setConnectionLimits - caps and deadlines for device TCP connections
+     *        (the epoll engine takes them at initialize)
+     * @param limits
+     */
+    //*****************************************************************************
+    void setConnectionLimits( const ConnectionLimits &limits ) { connGuard_->setLimits( limits ); }
+
+    //*****************************************************************************
+    //*****************************************************************************
+    /**
+     * @brief connectionStats - accepted/rejected connection counters
+     * @return
+     */
+    //*****************************************************************************
+    ConnectionStats connectionStats() const { return epoll_ ? epoll_->stats() : connGuard_->stats(); }
+
+    //*****************************************************************************
+    //*****************************************************************************
+    /**
+     * @brief setConnectionPoolSize - idle connection objects kept for reuse
+     * @param maxIdle
+     */
+    //*****************************************************************************
+    void setConnectionPoolSize( int maxIdle ) { connPool_->setMaxIdle( maxIdle ); }
+
+    //*****************************************************************************
+    //*****************************************************************************
+    /**
+     * @brief connectionPoolStats - connection objects created vs reused and
+     *        requests that had to grow a buffer
+     * @return
+     */
+    //*****************************************************************************
+    ConnectionPoolStats connectionPoolStats() const { return connPool_->stats(); }
+
+    //*****************************************************************************
+    //*****************************************************************************
+    /**
+     * @brief enableLogSignals - deliver log records through msgOut/error
+     *        (on by default, levels are set with FauxMoLog::setLevel)
+     * @param en
+     */
+    //*****************************************************************************
+    void enableLogSignals( bool en );
+
+    //*****************************************************************************
+    //*****************************************************************************
+    /**
+     * @brief enableTracing - record per-stage request timings
+     * @param en
+     */
+    //*****************************************************************************
+    void enableTracing( bool en ) { FauxMoTrace::setEnabled( en ); }
+
+    //*****************************************************************************
+    //*****************************************************************************
+    /**
+     * @brief dumpTrace - writes recorded timings as Chrome trace-event JSON
+     * @param fileName
+     * @return
+     */
+    //*****************************************************************************
+    bool dumpTrace( QString fileName ) { return FauxMoTrace::dump( fileName ); }
+
+    //*****************************************************************************
+    //*****************************************************************************
+    /**
+     * @brief startCapture - record inbound searches and device requests with
+     *        timestamps (format in FauxMoCapture.h), for FauxMoReplay
+     * @param fileName
+     * @return
+     */
+    //*****************************************************************************
+    bool startCapture( QString fileName ) { return FauxMoCapture::start( fileName ); }
+
+    //*****************************************************************************
+    //*****************************************************************************
+    /**
+     * @brief stopCapture - flushes and closes the capture file
+     */
+    //*****************************************************************************
+    void stopCapture() { FauxMoCapture::stop(); }
+
+    //*****************************************************************************
+    //*****************************************************************************
+    /**
+     * @brief enableWatchdog - measure event loop lag and handler run times
+     * @param en
+     */
+    //*****************************************************************************
+    void enableWatchdog( bool en ) { watchdog_->setEnabled( en ); }
+
+    //*****************************************************************************
+    //*****************************************************************************
+    /**
+     * @brief setStallThreshold - lag/run time that triggers stallDetected
+     * @param ms
+     */
+    //*****************************************************************************
+    void setStallThreshold( int ms ) { watchdog_->setStallThreshold( ms ); }
+
+    //*****************************************************************************
+    //*****************************************************************************
+    /**
+     * @brief latencyHistogram - loop lag or run time distribution for a phase
+     * @param phase
+     * @return
+     */
+    //*****************************************************************************
+    LatencyHistogram latencyHistogram( LoopWatchdog::Phase phase ) const { return watchdog_->histogram( phase ); }
+
 
 signals:
 
+    //*** log sink - Warning/Error records, emitted from this object's thread ***
     void error( QString errStr );
+
+    //*** log sink - other records, emitted from this object's thread ***
     void msgOut( QString msgStr );
 
     void setDeviceState( QString devName, bool state );
 
+    //*** event loop lag or a phase ran longer than the stall threshold ***
+    void stallDetected( QString phase, qint64 durationMs );
+
+    //*** config file (re)loaded ***
+    void configApplied( int added, int removed, int renamed );
+
+    //*** a group was switched - members already carry the new state ***
+    void setGroupState( QString groupName, QStringList members, bool state );
+
 
 private slots:
 
@@ -103,32 +398,152 @@ private slots:
     //*****************************************************************************
     void readPendingDatagrams();
 
+    //*****************************************************************************
+    //*****************************************************************************
+    /**
+     * @brief applyConfig
+     * @return
+     */
+    //*****************************************************************************
+    bool applyConfig();
+
+    //*****************************************************************************
+    //*****************************************************************************
+    /**
+     * @brief deviceStateChanged - forwards device states, fans groups out
+     * @param devName
+     * @param state
+     */
+    //*****************************************************************************
+    void deviceStateChanged( QString devName, bool state );
+
+    //*****************************************************************************
+    //*****************************************************************************
+    /**
+     * @brief epollStateSet - SetBinaryState served by the epoll engine
+     * @param devName
+     * @param state
+     */
+    //*****************************************************************************
+    void epollStateSet( QString devName, bool state );
+
 private:
 
     bool discoveryEnabled_;
 
     //*** TCP server port ***
-    quint16 nextTcpPort_;
+    quint32 nextTcpPort_;
+
+    //*** scale-out partition ***
+    int workerIndex_;
+    int workerCount_;
+    quint32 lastTcpPort_;
+    quint32 firstTcpPort_;
+
+    //*** ports of removed devices ***
+    QList<quint16> freePorts_;
+
+    //*** a device from the config file ***
+    struct ConfigEntry
+    {
+        QString name;
+        QString uuid;
+        quint16 port = 0;
+    };
+
+    //*** config file, devices it created by id ***
+    QString configFile_;
+    QFileSystemWatcher *configWatcher_;
+    QTimer configReload_;
+    QHash<QString,ConfigEntry> configDevices_;
+
+    //*** shared memory device state table ***
+    StateExport stateExport_;
 
      //*** maps ***
     QHash<QString,WemoDevice*> nameToDevice_;
 
-    QStringList patterns_;
+    //*** removed devices waiting for their deferred delete ***
+    QList< QPointer<WemoDevice> > removedDevices_;
+
+    //*** group devices and their member names ***
+    QHash<QString,QStringList> groups_;
+
+    //*** Wemo, Hue or both ***
+    EmulationMode emulationMode_;
+
+    //*** emulated Hue bridge, null unless in Hue mode ***
+    quint16 huePort_;
+    HueBridge *hueBridge_;
+
+    //*** Hue discovery response by local address ***
+    QHash<quint32,QByteArray> hueResponseCache_;
+
+    //*** an interface we answer discovery on ***
+    struct SsdpInterface
+    {
+        QNetworkInterface           netIF;
+        QList<QNetworkAddressEntry> addrs;      // IPv4 only
+    };
 
     bool haveInterface_;
-    QNetworkInterface netIF_;
-    QHostAddress localAddress_;
-    QString macStr_;
+    QStringList ifNames_;
+    QList<SsdpInterface> interfaces_;
 
     QUdpSocket *udp_;
 
+    //*** discovery responses by local address, device, target - after the date ***
+    QHash< quint32, QHash< WemoDevice*, QVector<QByteArray> > > responseCache_;
+    QByteArray responseHead_;
+
+    //*** response assembly buffer ***
+    QByteArray udpOut_;
+
+    //*** connection limits shared by all devices ***
+    ConnectionGuard *connGuard_;
+
+    //*** recycled client connections shared by all devices ***
+    ConnectionPool *connPool_;
+
+    //*** stall detection shared by all devices ***
+    LoopWatchdog *watchdog_;
+
+    //*** native engine, null when the Qt sockets are used ***
+    FauxMoEpoll *epoll_;
+
+    //*** log records go to msgOut/error ***
+    bool logSignals_;
+
+    void logToSignals( const LogRecord &rec );
+
     bool setupNetworkInterface();
 
     void setupUDP();
 
-    void sendUDPResponse( QHostAddress &addr, quint16 portIn, QString devName, QString pattern );
+    bool bindUDP();
+
+    void fallBackToQtEngine();
+
+    WemoDevice *createDevice( QString devName, QString uuid, quint16 port );
+
+    bool portInUse( quint16 port ) const;
+
+    void invalidateResponses( WemoDevice *dev );
+
+    void exportDevice( WemoDevice *dev );
+
+    void sendByeBye( WemoDevice *dev );
+
+    void setupHueBridge();
+
+    void sendHueResponse( const QHostAddress &addr, quint16 portIn, const QHostAddress &local );
+
+    bool parseConfig( QString fileName, QHash<QString,ConfigEntry> &wanted );
+
+    QHostAddress localAddressFor( int ifIndex, const QHostAddress &sender ) const;
 
-    QString timeStr() { return QDateTime::currentDateTime().toString( Qt::RFC2822Date ); }
+    void sendUDPResponse( const QHostAddress &addr, quint16 portIn, const QHostAddress &local,
+                          WemoDevice *device, SsdpTarget target );
 
 
 };
@@ -0,0 +1,379 @@
+#include "FauxMoReplay.h"
+#include "FauxMoProtocol.h"
+#include "FauxMoLog.h"
+
+#include <QFile>
+
+#include <climits>
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief FauxMoReplay::FauxMoReplay
+ * @param parent
+ */
+//*****************************************************************************
+FauxMoReplay::FauxMoReplay( QObject *parent )
+    : QObject(parent),
+      target_(QHostAddress::LocalHost),
+      speed_(1.0),
+      maxInFlight_(REPLAY_MAX_IN_FLIGHT),
+      next_(0),
+      running_(false)
+{
+    //*** one socket for all searches - responses come back to it ***
+    udp_ = new QUdpSocket( this );
+    connect( udp_, SIGNAL(readyRead()), SLOT(udpReadyRead()) );
+
+    sendTimer_.setSingleShot( true );
+    sendTimer_.setTimerType( Qt::PreciseTimer );
+    connect( &sendTimer_, SIGNAL(timeout()), SLOT(sendDue()) );
+
+    lingerTimer_.setSingleShot( true );
+    lingerTimer_.setInterval( REPLAY_LINGER_MS );
+    connect( &lingerTimer_, SIGNAL(timeout()), SLOT(linger()) );
+}
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief FauxMoReplay::~FauxMoReplay - open sockets and their timers are
+ *        children
+ */
+//*****************************************************************************
+FauxMoReplay::~FauxMoReplay()
+{
+}
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief FauxMoReplay::load
+ * @param fileName
+ * @return - false if the file is missing, not a capture or truncated
+ */
+//*****************************************************************************
+bool FauxMoReplay::load( const QString &fileName )
+{
+FauxMoCaptureHeader hdr;
+FauxMoCaptureRecord rec;
+
+    QFile file( fileName );
+    if ( !file.open( QIODevice::ReadOnly ) )
+    {
+        FAUXMO_LOG( General, Error, "", "Can't open capture file %s", qPrintable( fileName ) );
+        return false;
+    }
+
+    if ( file.read( reinterpret_cast<char*>(&hdr), sizeof(hdr) ) != qint64(sizeof(hdr)) ||
+         hdr.magic != FAUXMO_CAPTURE_MAGIC || hdr.version != FAUXMO_CAPTURE_VERSION )
+    {
+        FAUXMO_LOG( General, Error, "", "%s is not a capture file", qPrintable( fileName ) );
+        return false;
+    }
+
+    records_.clear();
+    data_.clear();
+    data_.reserve( int( qMin( file.size(), qint64(INT_MAX) ) ) );
+
+    while ( file.read( reinterpret_cast<char*>(&rec), sizeof(rec) ) == qint64(sizeof(rec)) )
+    {
+        Record r;
+        r.timeUs    = rec.timeUs;
+        r.localPort = rec.localPort;
+        r.kind      = rec.kind;
+        r.offset    = data_.size();
+        r.length    = int(rec.length);
+
+        QByteArray bytes = file.read( rec.length );
+        if ( bytes.size() != int(rec.length) )
+        {
+            FAUXMO_LOG( General, Warning, "", "%s is truncated, %d records read",
+                        qPrintable( fileName ), records_.size() );
+            break;
+        }
+
+        data_.append( bytes );
+        records_.append( r );
+    }
+
+    return true;
+}
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief FauxMoReplay::start
+ */
+//*****************************************************************************
+void FauxMoReplay::start()
+{
+    if ( running_ ) return;
+
+    stats_   = ReplayStats();
+    next_    = 0;
+    running_ = true;
+
+    if ( udp_->state() != QAbstractSocket::BoundState ) udp_->bind( QHostAddress::AnyIPv4, 0 );
+
+    clock_.start();
+
+    sendDue();
+}
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief FauxMoReplay::sendDue - sends records whose scaled capture time has
+ *        come, then sleeps until the next one. At full speed only the
+ *        in-flight cap holds records back.
+ */
+//*****************************************************************************
+void FauxMoReplay::sendDue()
+{
+    if ( !running_ ) return;
+
+    quint64 firstUs = records_.isEmpty() ? 0 : records_.first().timeUs;
+
+    while ( next_ < records_.size() )
+    {
+        const Record &rec = records_[next_];
+
+        //*** continued from httpDone when a slot frees up ***
+        if ( rec.kind == FauxMoCapture::Http && inFlight_.size() >= maxInFlight_ ) return;
+
+        if ( speed_ > 0 )
+        {
+            qint64 dueUs = qint64( double( rec.timeUs - firstUs ) / speed_ );
+            qint64 nowUs = clock_.nsecsElapsed() / 1000;
+
+            if ( dueUs > nowUs )
+            {
+                sendTimer_.start( int( ( dueUs - nowUs ) / 1000 ) );
+                return;
+            }
+
+            //*** more than a millisecond behind schedule ***
+            if ( nowUs - dueUs > 1000 ) stats_.lateRecords++;
+        }
+
+        next_++;
+        sendRecord( rec );
+    }
+
+    //*** all sent - wait for what's still open ***
+    if ( inFlight_.isEmpty() && !lingerTimer_.isActive() ) lingerTimer_.start();
+}
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief FauxMoReplay::sendRecord
+ * @param rec
+ */
+//*****************************************************************************
+void FauxMoReplay::sendRecord( const Record &rec )
+{
+    const char *bytes = data_.constData() + rec.offset;
+
+    if ( rec.kind == FauxMoCapture::Ssdp )
+    {
+        udp_->writeDatagram( bytes, rec.length, target_, rec.localPort );
+        stats_.datagrams++;
+        return;
+    }
+
+    if ( rec.kind != FauxMoCapture::Http ) return;
+
+    //*** one connection per request, like the controllers ***
+    QTcpSocket *sock = new QTcpSocket( this );
+
+    Request req;
+    req.record  = int( &rec - records_.constData() );
+    req.startUs = clock_.nsecsElapsed() / 1000;
+    req.timeout = new QTimer( sock );
+    req.timeout->setSingleShot( true );
+
+    connect( sock, SIGNAL(connected()), SLOT(httpConnected()) );
+    connect( sock, SIGNAL(readyRead()), SLOT(httpReadyRead()) );
+    connect( sock, SIGNAL(disconnected()), SLOT(httpDone()) );
+    connect( sock, SIGNAL(error(QAbstractSocket::SocketError)), SLOT(httpDone()) );
+    connect( req.timeout, SIGNAL(timeout()), SLOT(httpTimeout()) );
+
+    inFlight_.insert( sock, req );
+    stats_.requests++;
+
+    req.timeout->start( REPLAY_RESPONSE_TIMEOUT_MS );
+    sock->connectToHost( target_, rec.localPort );
+}
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief FauxMoReplay::udpReadyRead - counts discovery responses
+ */
+//*****************************************************************************
+void FauxMoReplay::udpReadyRead()
+{
+char buf[2048];
+
+    while ( udp_->hasPendingDatagrams() )
+    {
+        qint64 n = udp_->readDatagram( buf, sizeof(buf) );
+
+        if ( n > 0 && FauxMoProtocol::find( buf, int(n), "HTTP/1.1 200 OK" ) == 0 )
+            stats_.ssdpResponses++;
+    }
+}
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief FauxMoReplay::httpConnected - sends the captured request
+ */
+//*****************************************************************************
+void FauxMoReplay::httpConnected()
+{
+    QTcpSocket *sock = qobject_cast<QTcpSocket*>( sender() );
+    if ( !sock || !inFlight_.contains( sock ) ) return;
+
+    const Record &rec = records_[inFlight_[sock].record];
+
+    sock->write( data_.constData() + rec.offset, rec.length );
+}
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief FauxMoReplay::httpReadyRead
+ */
+//*****************************************************************************
+void FauxMoReplay::httpReadyRead()
+{
+    QTcpSocket *sock = qobject_cast<QTcpSocket*>( sender() );
+    if ( !sock || !inFlight_.contains( sock ) ) return;
+
+    inFlight_[sock].response.append( sock->readAll() );
+}
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief FauxMoReplay::httpDone - the instance closes after every response
+ */
+//*****************************************************************************
+void FauxMoReplay::httpDone()
+{
+    QTcpSocket *sock = qobject_cast<QTcpSocket*>( sender() );
+    if ( !sock || !inFlight_.contains( sock ) ) return;
+
+    finishRequest( sock, false );
+}
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief FauxMoReplay::httpTimeout
+ */
+//*****************************************************************************
+void FauxMoReplay::httpTimeout()
+{
+    //*** the timer belongs to its socket ***
+    QTcpSocket *sock = qobject_cast<QTcpSocket*>( sender()->parent() );
+    if ( !sock || !inFlight_.contains( sock ) ) return;
+
+    finishRequest( sock, true );
+}
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief FauxMoReplay::finishRequest - checks and counts the response, frees
+ *        the slot for the next request
+ * @param sock
+ * @param timedOut
+ */
+//*****************************************************************************
+void FauxMoReplay::finishRequest( QTcpSocket *sock, bool timedOut )
+{
+    Request req = inFlight_.take( sock );
+    req.timeout->stop();
+
+    //*** anything that arrived with the close ***
+    if ( sock->bytesAvailable() ) req.response.append( sock->readAll() );
+
+    if ( !timedOut && req.response.isEmpty() && sock->error() == QAbstractSocket::ConnectionRefusedError )
+        stats_.connectErrors++;
+    else if ( req.response.isEmpty() )
+        stats_.noResponse++;
+    else if ( checkResponse( req.response ) )
+        stats_.responsesOk++;
+    else
+        stats_.responsesBad++;
+
+    if ( !req.response.isEmpty() )
+        stats_.latency.add( clock_.nsecsElapsed() / 1000 - req.startUs );
+
+    //*** may be inside one of its own signals ***
+    sock->disconnect( this );
+    sock->abort();
+    sock->deleteLater();
+
+    sendDue();
+}
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief FauxMoReplay::checkResponse
+ * @param response
+ * @return - true for a 200 whose body matches its Content-Length
+ */
+//*****************************************************************************
+bool FauxMoReplay::checkResponse( const QByteArray &response )
+{
+    if ( FauxMoProtocol::find( response.constData(), response.size(), "HTTP/1.1 200 OK" ) != 0 ) return false;
+
+    int hdrEnd = FauxMoProtocol::find( response.constData(), response.size(), "\r\n\r\n" );
+    if ( hdrEnd < 0 ) return false;
+
+    qint64 bodyLen = FauxMoProtocol::contentLength( response.constData(), hdrEnd );
+
+    return bodyLen > 0 && response.size() - hdrEnd - 4 == bodyLen;
+}
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief FauxMoReplay::linger - late discovery responses are in, or a request
+ *        was sent while waiting
+ */
+//*****************************************************************************
+void FauxMoReplay::linger()
+{
+    if ( !running_ ) return;
+
+    if ( next_ < records_.size() || !inFlight_.isEmpty() ) return;
+
+    running_ = false;
+    stats_.elapsedMs = clock_.elapsed();
+
+    FAUXMO_LOG( General, Info, "", "Replay done: %llu searches, %llu responses, %llu/%llu requests ok",
+                stats_.datagrams, stats_.ssdpResponses, stats_.responsesOk, stats_.requests );
+
+    emit finished();
+}
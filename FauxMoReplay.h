@@ -0,0 +1,165 @@
+#ifndef FAUXMOREPLAY_H
+#define FAUXMOREPLAY_H
+
+#include "FauxMoLib_global.h"
+
+#include <QObject>
+#include <QTimer>
+#include <QElapsedTimer>
+#include <QUdpSocket>
+#include <QTcpSocket>
+#include <QHostAddress>
+#include <QHash>
+#include <QVector>
+
+#include "FauxMoCapture.h"
+#include "LoopWatchdog.h"
+
+//*** give up on a device response after this long ***
+const int REPLAY_RESPONSE_TIMEOUT_MS = 2000;
+
+//*** wait for late discovery responses before finishing ***
+const int REPLAY_LINGER_MS           = 500;
+
+//*** device connections open at once ***
+const int REPLAY_MAX_IN_FLIGHT       = 64;
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief The ReplayStats struct - what was sent and how the instance answered
+ */
+//*****************************************************************************
+struct ReplayStats
+{
+    quint64 datagrams       = 0;    // searches sent
+    quint64 ssdpResponses   = 0;    // discovery responses received
+    quint64 requests        = 0;    // device requests sent
+    quint64 responsesOk     = 0;    // 200 with a body matching Content-Length
+    quint64 responsesBad    = 0;    // anything else
+    quint64 noResponse      = 0;    // closed or timed out without a response
+    quint64 connectErrors   = 0;
+
+    //*** records sent later than their scaled capture time ***
+    quint64 lateRecords     = 0;
+
+    qint64  elapsedMs       = 0;
+
+    //*** connect to close, per device request ***
+    LatencyHistogram latency;
+};
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief The FauxMoReplay class - plays a capture file back against a local
+ *        instance at capture speed, N times faster or as fast as possible,
+ *        and checks the responses. Device requests go to the port they were
+ *        captured on, so the instance should have the same devices and ports
+ *        (a config file with ports). Searches are sent unicast to the target,
+ *        so a loopback instance needs setInterfaces( {"lo"} ).
+ */
+//*****************************************************************************
+class FAUXMOLIB_EXPORT FauxMoReplay : public QObject
+{
+    Q_OBJECT
+
+public:
+
+    //*** constructor ***
+    explicit FauxMoReplay( QObject *parent = nullptr );
+
+    //*** destructor ***
+    ~FauxMoReplay();
+
+    //*** reads a capture file ***
+    bool load( const QString &fileName );
+
+    //*** instance to replay against ***
+    void setTarget( const QHostAddress &target ) { target_ = target; }
+
+    //*** 1.0 = capture speed, N = N times faster, 0 = as fast as possible ***
+    void setSpeed( double speed ) { speed_ = speed; }
+
+    //*** device connections open at once ***
+    void setMaxInFlight( int max ) { maxInFlight_ = qMax( 1, max ); }
+
+    //*** records loaded ***
+    int recordCount() const { return records_.size(); }
+
+    //*** starts playing, finished is emitted at the end ***
+    void start();
+
+    ReplayStats stats() const { return stats_; }
+
+    //*** true for a 200 whose body matches its Content-Length ***
+    static bool checkResponse( const QByteArray &response );
+
+
+signals:
+
+    void finished();
+
+
+private slots:
+
+    //*** sends every record that is due ***
+    void sendDue();
+
+    void udpReadyRead();
+
+    void httpConnected();
+    void httpReadyRead();
+    void httpDone();
+    void httpTimeout();
+
+    void linger();
+
+
+private:
+
+    //*** a record, data kept in one buffer ***
+    struct Record
+    {
+        quint64 timeUs;
+        quint16 localPort;
+        quint8  kind;
+        int     offset;
+        int     length;
+    };
+
+    //*** a device request in progress ***
+    struct Request
+    {
+        int     record;
+        qint64  startUs;
+        QByteArray response;
+        QTimer  *timeout;
+    };
+
+    void sendRecord( const Record &rec );
+    void finishRequest( QTcpSocket *sock, bool timedOut );
+
+    QHostAddress target_;
+    double speed_;
+    int maxInFlight_;
+
+    QVector<Record> records_;
+    QByteArray data_;
+
+    int next_;
+    bool running_;
+
+    QUdpSocket *udp_;
+    QHash<QTcpSocket*,Request> inFlight_;
+
+    QTimer sendTimer_;
+    QTimer lingerTimer_;
+    QElapsedTimer clock_;
+
+    ReplayStats stats_;
+};
+
+#endif // FAUXMOREPLAY_H
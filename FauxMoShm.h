@@ -0,0 +1,144 @@
+#ifndef FAUXMOSHM_H
+#define FAUXMOSHM_H
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * Layout of the shared memory device state table published by FauxMoQt
+ * (see FauxMoQt::enableStateExport). No Qt dependency so other local
+ * processes can include it.
+ *
+ *   [FauxMoShmHeader][FauxMoShmEntry x capacity][name slot x capacity]
+ *
+ * Entries use seqlock semantics - 'seq' is odd while an entry is being
+ * written. Every change also bumps header 'changeSeq', which readers can
+ * poll or futex-wait on.
+ */
+//*****************************************************************************
+
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__linux__)
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <time.h>
+#endif
+
+#define FAUXMO_SHM_MAGIC        0x4f4d5846u     // "FXMO"
+#define FAUXMO_SHM_VERSION      1u
+#define FAUXMO_SHM_NAME_SIZE    64u             // bytes per name slot, NUL terminated
+
+//*** entry flags ***
+#define FAUXMO_SHM_IN_USE       0x1u
+
+struct FauxMoShmHeader
+{
+    uint32_t magic;         // set last - table is ready when this is valid
+    uint32_t version;
+    uint32_t capacity;      // number of entries
+    uint32_t entrySize;     // sizeof(FauxMoShmEntry)
+    uint32_t entryOffset;   // from start of table
+    uint32_t namesOffset;   // from start of table
+    uint32_t changeSeq;     // bumped on every change - futex word
+    uint32_t waiters;       // readers blocked on changeSeq
+    uint8_t  pad[32];
+};
+
+struct FauxMoShmEntry
+{
+    uint32_t seq;           // seqlock - odd while writing
+    uint32_t deviceId;      // stable while the device exists
+    uint32_t nameOffset;    // from start of table
+    uint32_t flags;         // FAUXMO_SHM_IN_USE
+    int64_t  lastChangeMs;  // ms since epoch
+    uint32_t state;         // 0 = off, 1 = on
+    uint32_t changeCount;   // state changes since creation
+    uint8_t  pad[32];
+};
+
+
+#if defined(__GNUC__)
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief fauxmoShmReadEntry - consistent copy of an entry and its name
+ * @param table - start of the mapped table
+ * @param index - entry index
+ * @param out - receives the entry
+ * @param name - receives the name, FAUXMO_SHM_NAME_SIZE bytes
+ */
+//*****************************************************************************
+inline void fauxmoShmReadEntry( const void *table, uint32_t index, FauxMoShmEntry *out, char *name )
+{
+    const FauxMoShmHeader *hdr = (const FauxMoShmHeader*)table;
+    const FauxMoShmEntry  *e   = (const FauxMoShmEntry*)( (const char*)table + hdr->entryOffset ) + index;
+
+    uint32_t s1, s2;
+
+    for (;;)
+    {
+        s1 = __atomic_load_n( &e->seq, __ATOMIC_ACQUIRE );
+        if ( s1 & 1u ) continue;
+
+        memcpy( out, e, sizeof(*out) );
+        memcpy( name, (const char*)table + hdr->namesOffset + index * FAUXMO_SHM_NAME_SIZE, FAUXMO_SHM_NAME_SIZE );
+
+        __atomic_thread_fence( __ATOMIC_ACQUIRE );
+        s2 = __atomic_load_n( &e->seq, __ATOMIC_RELAXED );
+
+        if ( s1 == s2 ) break;
+    }
+
+    name[FAUXMO_SHM_NAME_SIZE - 1] = 0;
+}
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief fauxmoShmChangeSeq - current change counter, poll this
+ * @param table
+ * @return
+ */
+//*****************************************************************************
+inline uint32_t fauxmoShmChangeSeq( const void *table )
+{
+    return __atomic_load_n( &((const FauxMoShmHeader*)table)->changeSeq, __ATOMIC_ACQUIRE );
+}
+
+
+#if defined(__linux__)
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief fauxmoShmWait - blocks until changeSeq differs from 'seen' (table
+ *        must be mapped writable, the waiter count lives in the header)
+ * @param table
+ * @param seen - last change counter the caller has processed
+ * @param timeoutMs - < 0 waits forever
+ * @return - current change counter
+ */
+//*****************************************************************************
+inline uint32_t fauxmoShmWait( void *table, uint32_t seen, int timeoutMs )
+{
+    FauxMoShmHeader *hdr = (FauxMoShmHeader*)table;
+
+    struct timespec ts;
+    ts.tv_sec  = timeoutMs / 1000;
+    ts.tv_nsec = ( timeoutMs % 1000 ) * 1000000L;
+
+    __atomic_add_fetch( &hdr->waiters, 1u, __ATOMIC_SEQ_CST );
+
+    if ( __atomic_load_n( &hdr->changeSeq, __ATOMIC_SEQ_CST ) == seen )
+        syscall( SYS_futex, &hdr->changeSeq, FUTEX_WAIT, seen, timeoutMs < 0 ? NULL : &ts, NULL, 0 );
+
+    __atomic_sub_fetch( &hdr->waiters, 1u, __ATOMIC_SEQ_CST );
+
+    return fauxmoShmChangeSeq( table );
+}
+#endif // __linux__
+#endif // __GNUC__
+
+#endif // FAUXMOSHM_H
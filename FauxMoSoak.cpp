@@ -0,0 +1,581 @@
+#include "FauxMoSoak.h"
+#include "FauxMoReplay.h"
+#include "FauxMoProtocol.h"
+#include "FauxMoLog.h"
+
+#include <QFile>
+#include <QDir>
+
+#include <algorithm>
+
+#if defined(Q_OS_LINUX)
+#include <unistd.h>
+#endif
+
+//*** how often the rates are topped up ***
+const int SOAK_TICK_MS          = 10;
+
+//*** give up on a device response after this long ***
+const int SOAK_RESPONSE_TIMEOUT = 2000;
+
+//*** growth below these is noise, whatever the percentage ***
+const qint64 SOAK_RSS_SLACK_KB  = 1024;
+const int    SOAK_FD_SLACK      = 4;
+const qint64 SOAK_LATENCY_SLACK = 250;
+
+//*** search for every device ***
+const char SOAK_SEARCH[] =
+    "M-SEARCH * HTTP/1.1\r\n"
+    "HOST: 239.255.255.250:1900\r\n"
+    "MAN: \"ssdp:discover\"\r\n"
+    "MX: 1\r\n"
+    "ST: urn:Belkin:device:controllee:1\r\n"
+    "\r\n";
+
+//*** device requests, %1 = host:port, %2 = Content-Length, %3 = body, %4 = action ***
+const char SOAK_SETUP_REQUEST[] =
+    "GET /setup.xml HTTP/1.1\r\n"
+    "Host: %1\r\n"
+    "\r\n";
+
+const char SOAK_ACTION_REQUEST[] =
+    "POST /upnp/control/basicevent1 HTTP/1.1\r\n"
+    "Host: %1\r\n"
+    "Content-Type: text/xml; charset=\"utf-8\"\r\n"
+    "SOAPACTION: \"urn:Belkin:service:basicevent:1#%4\"\r\n"
+    "Content-Length: %2\r\n"
+    "\r\n"
+    "%3";
+
+const char SOAK_ACTION_BODY[] =
+    "<?xml version=\"1.0\" encoding=\"utf-8\"?>"
+    "<s:Envelope xmlns:s=\"http://schemas.xmlsoap.org/soap/envelope/\" "
+    "s:encodingStyle=\"http://schemas.xmlsoap.org/soap/encoding/\"><s:Body>"
+    "<u:%1 xmlns:u=\"urn:Belkin:service:basicevent:1\">%2</u:%1>"
+    "</s:Body></s:Envelope>";
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief FauxMoSoak::FauxMoSoak
+ * @param parent
+ */
+//*****************************************************************************
+FauxMoSoak::FauxMoSoak( QObject *parent )
+    : QObject(parent),
+      target_(QHostAddress::LocalHost),
+      running_(false),
+      searchesSent_(0),
+      requestsSent_(0),
+      requestSeq_(0)
+{
+    //*** one socket for all searches - responses come back to it ***
+    udp_ = new QUdpSocket( this );
+    connect( udp_, SIGNAL(readyRead()), SLOT(udpReadyRead()) );
+
+    tickTimer_.setTimerType( Qt::PreciseTimer );
+    tickTimer_.setInterval( SOAK_TICK_MS );
+    connect( &tickTimer_, SIGNAL(timeout()), SLOT(tick()) );
+
+    connect( &sampleTimer_, SIGNAL(timeout()), SLOT(sample()) );
+}
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief FauxMoSoak::start
+ */
+//*****************************************************************************
+void FauxMoSoak::start()
+{
+    if ( running_ ) return;
+
+    running_      = true;
+    searchesSent_ = 0;
+    requestsSent_ = 0;
+    requestSeq_   = 0;
+
+    ports_.clear();
+    samples_.clear();
+    interval_ = SoakSample();
+    latencies_.resize( 0 );
+    runLatencies_.clear();
+
+    if ( udp_->state() != QAbstractSocket::BoundState ) udp_->bind( QHostAddress::AnyIPv4, 0 );
+
+    clock_.start();
+
+    tickTimer_.start();
+    sampleTimer_.start( qMax( 1, config_.sampleIntervalSec ) * 1000 );
+
+    FAUXMO_LOG( General, Info, "", "Soak started: %d s, %d searches/s, %d requests/s",
+                config_.durationSec, config_.searchesPerSec, config_.requestsPerSec );
+}
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief FauxMoSoak::stop
+ */
+//*****************************************************************************
+void FauxMoSoak::stop()
+{
+QString report;
+
+    if ( !running_ ) return;
+
+    running_ = false;
+
+    tickTimer_.stop();
+    sampleTimer_.stop();
+
+    //*** requests still open are not part of any sample ***
+    foreach( auto sock, inFlight_.keys() )
+    {
+        sock->disconnect( this );
+        sock->abort();
+        sock->deleteLater();
+    }
+    inFlight_.clear();
+
+    bool passed = evaluate( report );
+
+    if ( passed )
+        FAUXMO_LOG( General, Info, "", "Soak passed\n%s", qPrintable( report ) );
+    else
+        FAUXMO_LOG( General, Error, "", "Soak failed\n%s", qPrintable( report ) );
+
+    emit finished( passed, report );
+}
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief FauxMoSoak::tick - keeps the totals sent in line with the rates, so
+ *        a late tick catches up instead of lowering the load
+ */
+//*****************************************************************************
+void FauxMoSoak::tick()
+{
+    qint64 elapsedMs = clock_.elapsed();
+
+    if ( elapsedMs >= qint64(config_.durationSec) * 1000 )
+    {
+        sample();
+        stop();
+        return;
+    }
+
+    quint64 searchesDue = quint64( elapsedMs * config_.searchesPerSec / 1000 );
+    while ( searchesSent_ < searchesDue )
+    {
+        sendSearch();
+        searchesSent_++;
+    }
+
+    //*** nothing to talk to until discovery has answered ***
+    if ( ports_.isEmpty() )
+    {
+        requestsSent_ = quint64( elapsedMs * config_.requestsPerSec / 1000 );
+        return;
+    }
+
+    quint64 requestsDue = quint64( elapsedMs * config_.requestsPerSec / 1000 );
+    while ( requestsSent_ < requestsDue )
+    {
+        requestsSent_++;
+
+        if ( inFlight_.size() >= config_.maxInFlight )
+        {
+            interval_.dropped++;
+            continue;
+        }
+
+        sendRequest();
+    }
+}
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief FauxMoSoak::sendSearch
+ */
+//*****************************************************************************
+void FauxMoSoak::sendSearch()
+{
+static const QByteArray search( SOAK_SEARCH );
+
+    udp_->writeDatagram( search, target_, 1900 );
+}
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief FauxMoSoak::sendRequest - round robin over the devices, cycling
+ *        through state polls, state changes and setup.xml
+ */
+//*****************************************************************************
+void FauxMoSoak::sendRequest()
+{
+QByteArray request;
+
+    quint64 seq  = requestSeq_++;
+    quint16 port = ports_.at( int( seq % quint64(ports_.size()) ) );
+
+    QString host = target_.toString() + ":" + QString::number( port );
+
+    //*** the same device comes round again every ports_.size() requests ***
+    switch ( ( seq / quint64(ports_.size()) ) % 4 )
+    {
+    case 0:
+        request = QString( SOAK_SETUP_REQUEST ).arg( host ).toUtf8();
+        break;
+
+    case 1:
+    case 3:
+    {
+        QString body = QString( SOAK_ACTION_BODY ).arg( "GetBinaryState" ).arg( "" );
+        request = QString( SOAK_ACTION_REQUEST ).arg( host ).arg( body.size() ).arg( body ).arg( "GetBinaryState" ).toUtf8();
+        break;
+    }
+
+    default:
+    {
+        //*** toggles, so the state really changes every time ***
+        QString state = QString( "<BinaryState>%1</BinaryState>" ).arg( int( ( seq / quint64(ports_.size()) / 4 ) & 1 ) );
+        QString body = QString( SOAK_ACTION_BODY ).arg( "SetBinaryState" ).arg( state );
+        request = QString( SOAK_ACTION_REQUEST ).arg( host ).arg( body.size() ).arg( body ).arg( "SetBinaryState" ).toUtf8();
+        break;
+    }
+    }
+
+    //*** one connection per request, like the controllers ***
+    QTcpSocket *sock = new QTcpSocket( this );
+    sock->setProperty( "request", request );
+
+    Request req;
+    req.startUs = clock_.nsecsElapsed() / 1000;
+    req.timeout = new QTimer( sock );
+    req.timeout->setSingleShot( true );
+
+    connect( sock, SIGNAL(connected()), SLOT(httpConnected()) );
+    connect( sock, SIGNAL(readyRead()), SLOT(httpReadyRead()) );
+    connect( sock, SIGNAL(disconnected()), SLOT(httpDone()) );
+    connect( sock, SIGNAL(error(QAbstractSocket::SocketError)), SLOT(httpDone()) );
+    connect( req.timeout, SIGNAL(timeout()), SLOT(httpTimeout()) );
+
+    inFlight_.insert( sock, req );
+    interval_.requests++;
+
+    req.timeout->start( SOAK_RESPONSE_TIMEOUT );
+    sock->connectToHost( target_, port );
+}
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief FauxMoSoak::udpReadyRead - learns device ports from LOCATION
+ */
+//*****************************************************************************
+void FauxMoSoak::udpReadyRead()
+{
+char buf[2048];
+
+    while ( udp_->hasPendingDatagrams() )
+    {
+        qint64 n = udp_->readDatagram( buf, sizeof(buf) );
+        if ( n <= 0 ) continue;
+
+        //*** LOCATION: http://ip:port/setup.xml ***
+        int loc = FauxMoProtocol::find( buf, int(n), "LOCATION: http://" );
+        if ( loc < 0 ) continue;
+
+        QByteArray location = QByteArray( buf + loc + 17, int(n) - loc - 17 );
+        location.truncate( location.indexOf( '/' ) );
+
+        bool ok = false;
+        quint16 port = location.mid( location.lastIndexOf( ':' ) + 1 ).toUShort( &ok );
+
+        if ( ok && !ports_.contains( port ) ) ports_.append( port );
+    }
+}
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief FauxMoSoak::httpConnected
+ */
+//*****************************************************************************
+void FauxMoSoak::httpConnected()
+{
+    QTcpSocket *sock = qobject_cast<QTcpSocket*>( sender() );
+    if ( !sock || !inFlight_.contains( sock ) ) return;
+
+    sock->write( sock->property( "request" ).toByteArray() );
+}
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief FauxMoSoak::httpReadyRead
+ */
+//*****************************************************************************
+void FauxMoSoak::httpReadyRead()
+{
+    QTcpSocket *sock = qobject_cast<QTcpSocket*>( sender() );
+    if ( !sock || !inFlight_.contains( sock ) ) return;
+
+    inFlight_[sock].response.append( sock->readAll() );
+}
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief FauxMoSoak::httpDone - the instance closes after every response
+ */
+//*****************************************************************************
+void FauxMoSoak::httpDone()
+{
+    QTcpSocket *sock = qobject_cast<QTcpSocket*>( sender() );
+    if ( !sock || !inFlight_.contains( sock ) ) return;
+
+    finishRequest( sock, false );
+}
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief FauxMoSoak::httpTimeout
+ */
+//*****************************************************************************
+void FauxMoSoak::httpTimeout()
+{
+    //*** the timer belongs to its socket ***
+    QTcpSocket *sock = qobject_cast<QTcpSocket*>( sender()->parent() );
+    if ( !sock || !inFlight_.contains( sock ) ) return;
+
+    finishRequest( sock, true );
+}
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief FauxMoSoak::finishRequest
+ * @param sock
+ * @param timedOut
+ */
+//*****************************************************************************
+void FauxMoSoak::finishRequest( QTcpSocket *sock, bool timedOut )
+{
+    Request req = inFlight_.take( sock );
+    req.timeout->stop();
+
+    if ( sock->bytesAvailable() ) req.response.append( sock->readAll() );
+
+    if ( timedOut || !FauxMoReplay::checkResponse( req.response ) )
+    {
+        interval_.errors++;
+    }
+    else
+    {
+        qint64 us = clock_.nsecsElapsed() / 1000 - req.startUs;
+
+        latencies_.append( us );
+        if ( config_.keepLatencies ) runLatencies_.append( us );
+    }
+
+    //*** may be inside one of its own signals ***
+    sock->disconnect( this );
+    sock->abort();
+    sock->deleteLater();
+}
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief FauxMoSoak::sample - closes the current interval
+ */
+//*****************************************************************************
+void FauxMoSoak::sample()
+{
+    if ( !running_ ) return;
+
+    interval_.elapsedMs = clock_.elapsed();
+    interval_.rssKb     = residentKb();
+    interval_.openFds   = openFdCount();
+    interval_.devices   = ports_.size();
+
+    std::sort( latencies_.begin(), latencies_.end() );
+    interval_.p50Us     = percentileUs( latencies_, 50 );
+    interval_.p99Us     = percentileUs( latencies_, 99 );
+
+    samples_.append( interval_ );
+
+    FAUXMO_LOG( General, Debug, "", "Soak %lld s: rss %lld kB, %d fds, %d devices, "
+                "%llu requests, %llu errors, %llu dropped, p50 %lld us, p99 %lld us",
+                interval_.elapsedMs / 1000, interval_.rssKb, interval_.openFds, interval_.devices,
+                interval_.requests, interval_.errors, interval_.dropped, interval_.p50Us, interval_.p99Us );
+
+    emit sampled( interval_ );
+
+    interval_ = SoakSample();
+    latencies_.resize( 0 );
+}
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief FauxMoSoak::percentileUs - the smallest latency that at least pct
+ *        percent of the requests did not exceed
+ * @param sorted - ascending
+ * @param pct - 1 .. 100
+ * @return
+ */
+//*****************************************************************************
+qint64 FauxMoSoak::percentileUs( const QVector<qint64> &sorted, int pct )
+{
+    if ( sorted.isEmpty() ) return 0;
+
+    int rank = int( ( qint64(sorted.size()) * pct + 99 ) / 100 );
+
+    return sorted.at( qBound( 1, rank, sorted.size() ) - 1 );
+}
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief FauxMoSoak::evaluate - compares the mean of the last quarter of the
+ *        samples after warm-up with the mean of the first quarter
+ * @param report
+ * @return
+ */
+//*****************************************************************************
+bool FauxMoSoak::evaluate( QString &report ) const
+{
+QVector<SoakSample> steady;
+bool passed = true;
+
+    foreach( auto s, samples_ )
+        if ( s.elapsedMs > qint64(config_.warmupSec) * 1000 ) steady.append( s );
+
+    if ( steady.size() < 4 )
+    {
+        report = QString( "too few samples after warm-up (%1)" ).arg( steady.size() );
+        return false;
+    }
+
+    int quarter = steady.size() / 4;
+
+    //*** one metric: mean of a sample field over a range ***
+    auto mean = [&]( int from, int to, qint64 (*field)( const SoakSample & ) )
+    {
+        qint64 sum = 0;
+        for ( int i = from; i < to; i++ ) sum += field( steady[i] );
+        return sum / ( to - from );
+    };
+
+    struct Metric
+    {
+        const char *name;
+        qint64 (*field)( const SoakSample & );
+        qint64 slack;
+    };
+
+    const Metric metrics[] =
+    {
+        { "rss kB",  []( const SoakSample &s ) { return s.rssKb; },          SOAK_RSS_SLACK_KB  },
+        { "fds",     []( const SoakSample &s ) { return qint64(s.openFds); }, qint64(SOAK_FD_SLACK) },
+        { "p50 us",  []( const SoakSample &s ) { return s.p50Us; },          SOAK_LATENCY_SLACK },
+        { "p99 us",  []( const SoakSample &s ) { return s.p99Us; },          SOAK_LATENCY_SLACK }
+    };
+
+    for ( const Metric &m : metrics )
+    {
+        qint64 first = mean( 0, quarter, m.field );
+        qint64 last  = mean( steady.size() - quarter, steady.size(), m.field );
+
+        //*** not available on this platform ***
+        if ( first < 0 ) continue;
+
+        qint64 limit = qMax( qint64( double(first) * ( 1.0 + config_.maxGrowthPct / 100.0 ) ), first + m.slack );
+        bool ok = last <= limit;
+
+        report += QString( "%1: %2 -> %3 (limit %4) %5\n" )
+                  .arg( m.name ).arg( first ).arg( last ).arg( limit ).arg( ok ? "ok" : "FAIL" );
+
+        passed = passed && ok;
+    }
+
+    //*** errors are a failure whatever the trend ***
+    quint64 requests = 0, errors = 0, dropped = 0;
+    foreach( auto s, steady )
+    {
+        requests += s.requests;
+        errors   += s.errors;
+        dropped  += s.dropped;
+    }
+
+    report += QString( "requests: %1, errors: %2, dropped: %3\n" ).arg( requests ).arg( errors ).arg( dropped );
+
+    return passed && errors == 0 && requests > 0;
+}
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief FauxMoSoak::residentKb - from /proc/self/statm
+ * @return
+ */
+//*****************************************************************************
+qint64 FauxMoSoak::residentKb()
+{
+#if defined(Q_OS_LINUX)
+    QFile statm( "/proc/self/statm" );
+    if ( !statm.open( QIODevice::ReadOnly ) ) return -1;
+
+    //*** size resident shared ... in pages ***
+    QList<QByteArray> fields = statm.readAll().split( ' ' );
+    if ( fields.size() < 2 ) return -1;
+
+    return fields.at( 1 ).toLongLong() * ( sysconf( _SC_PAGESIZE ) / 1024 );
+#else
+    return -1;
+#endif
+}
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief FauxMoSoak::openFdCount - entries in /proc/self/fd
+ * @return
+ */
+//*****************************************************************************
+int FauxMoSoak::openFdCount()
+{
+#if defined(Q_OS_LINUX)
+    QDir fds( "/proc/self/fd" );
+    if ( !fds.exists() ) return -1;
+
+    //*** includes the one used to list the directory ***
+    return fds.entryList( QDir::NoDotAndDotDot | QDir::System | QDir::Files | QDir::Dirs ).size();
+#else
+    return -1;
+#endif
+}
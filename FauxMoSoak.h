@@ -0,0 +1,186 @@
+#ifndef FAUXMOSOAK_H
+#define FAUXMOSOAK_H
+
+#include "FauxMoLib_global.h"
+
+#include <QObject>
+#include <QTimer>
+#include <QElapsedTimer>
+#include <QUdpSocket>
+#include <QTcpSocket>
+#include <QHostAddress>
+#include <QHash>
+#include <QList>
+#include <QVector>
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief The SoakConfig struct - load, duration and pass criteria
+ */
+//*****************************************************************************
+struct SoakConfig
+{
+    //*** total run time ***
+    int durationSec         = 3600;
+
+    //*** time between samples ***
+    int sampleIntervalSec   = 10;
+
+    //*** samples taken in this time are not part of the trend (pools, arenas fill) ***
+    int warmupSec           = 60;
+
+    //*** steady load ***
+    int searchesPerSec      = 10;
+    int requestsPerSec      = 100;
+
+    //*** device connections open at once - requests beyond it are dropped ***
+    int maxInFlight         = 64;
+
+    //*** allowed rise of the last quarter over the first, per metric ***
+    double maxGrowthPct     = 20.0;
+
+    //*** keep every latency of the run for latencies() - grows with the
+    //*** run, so not for leak checks ***
+    bool keepLatencies      = false;
+};
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief The SoakSample struct - one sampling interval
+ */
+//*****************************************************************************
+struct SoakSample
+{
+    qint64  elapsedMs   = 0;
+    qint64  rssKb       = -1;       // -1 if not available on this platform
+    int     openFds     = -1;
+    int     devices     = 0;        // found by discovery so far
+
+    //*** device requests in this interval ***
+    quint64 requests    = 0;
+    quint64 errors      = 0;        // bad response, no response, refused
+    quint64 dropped     = 0;        // not sent, in-flight cap reached
+    qint64  p50Us       = 0;
+    qint64  p99Us       = 0;
+};
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief The FauxMoSoak class - long running leak/drift check. Drives a
+ *        steady load of searches and device control requests at an
+ *        instance (normally one in the same process on loopback, with
+ *        setInterfaces( {"lo"} )), samples RSS, open fds and latency
+ *        percentiles (exact, from every request of the interval), and at
+ *        the end fails if the last quarter of the run is worse than the
+ *        first by more than maxGrowthPct. Devices are found through
+ *        discovery, so any number can be configured on the instance. RSS
+ *        and fds are this process's, load generator included.
+ */
+//*****************************************************************************
+class FAUXMOLIB_EXPORT FauxMoSoak : public QObject
+{
+    Q_OBJECT
+
+public:
+
+    //*** constructor ***
+    explicit FauxMoSoak( QObject *parent = nullptr );
+
+    //*** settings - call before start ***
+    void setConfig( const SoakConfig &config ) { config_ = config; }
+    void setTarget( const QHostAddress &target ) { target_ = target; }
+
+    //*** runs for the configured duration, finished is emitted at the end ***
+    void start();
+
+    //*** ends the run early and evaluates what was sampled ***
+    void stop();
+
+    QList<SoakSample> samples() const { return samples_; }
+
+    //*** good response latencies of the whole run, with keepLatencies ***
+    QVector<qint64> latencies() const { return runLatencies_; }
+
+    //*** process figures, -1 if not available ***
+    static qint64 residentKb();
+    static int openFdCount();
+
+    //*** nearest rank percentile of ascending latencies, 0 if empty ***
+    static qint64 percentileUs( const QVector<qint64> &sorted, int pct );
+
+
+signals:
+
+    //*** a sample was taken ***
+    void sampled( SoakSample sample );
+
+    //*** run over - report has one line per metric ***
+    void finished( bool passed, QString report );
+
+
+private slots:
+
+    //*** sends what the rates say is due ***
+    void tick();
+
+    void sample();
+
+    void udpReadyRead();
+
+    void httpConnected();
+    void httpReadyRead();
+    void httpDone();
+    void httpTimeout();
+
+
+private:
+
+    //*** a device request in progress ***
+    struct Request
+    {
+        qint64  startUs;
+        QByteArray response;
+        QTimer  *timeout;
+    };
+
+    void sendSearch();
+    void sendRequest();
+    void finishRequest( QTcpSocket *sock, bool timedOut );
+    bool evaluate( QString &report ) const;
+
+    SoakConfig config_;
+    QHostAddress target_;
+
+    bool running_;
+
+    QUdpSocket *udp_;
+
+    //*** device ports learned from discovery responses ***
+    QList<quint16> ports_;
+
+    //*** sent since start, for rate pacing ***
+    quint64 searchesSent_;
+    quint64 requestsSent_;
+    quint64 requestSeq_;
+
+    QHash<QTcpSocket*,Request> inFlight_;
+
+    QTimer tickTimer_;
+    QTimer sampleTimer_;
+    QElapsedTimer clock_;
+
+    //*** current interval - latencies of good responses, capacity kept ***
+    SoakSample interval_;
+    QVector<qint64> latencies_;
+
+    QList<SoakSample> samples_;
+    QVector<qint64> runLatencies_;
+};
+
+#endif // FAUXMOSOAK_H
@@ -0,0 +1,216 @@
+#include "FauxMoTrace.h"
+
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QVector>
+#include <QFile>
+
+//*** events kept per thread - must be a power of 2 ***
+const quint64 TRACE_RING_SIZE = 8192;
+
+std::atomic<bool> FauxMoTrace::enabled_( false );
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief The TraceRing struct - written only by its own thread
+ */
+//*****************************************************************************
+struct TraceRing
+{
+    struct Event
+    {
+        qint64  startUs;
+        qint64  durUs;
+        quint64 id;
+        int     stage;
+    };
+
+    TraceRing( int t ) : tid(t), head(0) {}
+
+    int tid;
+    std::atomic<quint64> head;
+    Event events[TRACE_RING_SIZE];
+};
+
+
+//*** all rings - kept for the life of the process so a dump can read rings
+//*** of threads that have exited ***
+static QMutex ringLock;
+static QVector<TraceRing*> rings;
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief threadRing - this thread's ring, created on first use
+ * @return
+ */
+//*****************************************************************************
+static TraceRing *threadRing()
+{
+    static thread_local TraceRing *ring = nullptr;
+
+    if ( !ring )
+    {
+        QMutexLocker lock( &ringLock );
+        ring = new TraceRing( rings.size() + 1 );
+        rings.append( ring );
+    }
+
+    return ring;
+}
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief FauxMoTrace::nowUs
+ * @return
+ */
+//*****************************************************************************
+qint64 FauxMoTrace::nowUs()
+{
+    static QElapsedTimer clock;
+    static bool started = ( clock.start(), true );
+    Q_UNUSED( started );
+
+    return clock.nsecsElapsed() / 1000;
+}
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief FauxMoTrace::record
+ * @param stage
+ * @param id - request id (socket, peer, ...)
+ * @param startUs
+ * @param endUs
+ */
+//*****************************************************************************
+void FauxMoTrace::record( Stage stage, quint64 id, qint64 startUs, qint64 endUs )
+{
+    TraceRing *ring = threadRing();
+
+    quint64 pos = ring->head.load( std::memory_order_relaxed );
+
+    TraceRing::Event &ev = ring->events[pos & (TRACE_RING_SIZE - 1)];
+    ev.startUs = startUs;
+    ev.durUs   = endUs - startUs;
+    ev.id      = id;
+    ev.stage   = stage;
+
+    ring->head.store( pos + 1, std::memory_order_release );
+}
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief FauxMoTrace::toChromeJson - events still being overwritten by a busy
+ *        thread during the dump may be inconsistent
+ * @return
+ */
+//*****************************************************************************
+QByteArray FauxMoTrace::toChromeJson()
+{
+QByteArray json;
+bool first = true;
+
+    qint64 pid = QCoreApplication::applicationPid();
+
+    json += "{\"traceEvents\":[\n";
+
+    QMutexLocker lock( &ringLock );
+
+    foreach( auto ring, rings )
+    {
+        quint64 head  = ring->head.load( std::memory_order_acquire );
+        quint64 start = head > TRACE_RING_SIZE ? head - TRACE_RING_SIZE : 0;
+
+        for ( quint64 i = start; i < head; i++ )
+        {
+            const TraceRing::Event &ev = ring->events[i & (TRACE_RING_SIZE - 1)];
+
+            if ( !first ) json += ",\n";
+            first = false;
+
+            json += QString( "{\"name\":\"%1\",\"cat\":\"fauxmo\",\"ph\":\"X\","
+                             "\"ts\":%2,\"dur\":%3,\"pid\":%4,\"tid\":%5,"
+                             "\"args\":{\"id\":\"0x%6\"}}" )
+                    .arg( stageName( Stage(ev.stage) ) )
+                    .arg( ev.startUs )
+                    .arg( ev.durUs )
+                    .arg( pid )
+                    .arg( ring->tid )
+                    .arg( ev.id, 0, 16 )
+                    .toUtf8();
+        }
+    }
+
+    json += "\n]}\n";
+
+    return json;
+}
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief FauxMoTrace::dump
+ * @param fileName
+ * @return
+ */
+//*****************************************************************************
+bool FauxMoTrace::dump( const QString &fileName )
+{
+    QFile file( fileName );
+
+    if ( !file.open( QIODevice::WriteOnly | QIODevice::Truncate ) ) return false;
+
+    QByteArray json = toChromeJson();
+
+    return file.write( json ) == json.size();
+}
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief FauxMoTrace::clear - only safe while tracing is disabled
+ */
+//*****************************************************************************
+void FauxMoTrace::clear()
+{
+    QMutexLocker lock( &ringLock );
+
+    foreach( auto ring, rings )
+        ring->head.store( 0 );
+}
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief FauxMoTrace::stageName
+ * @param stage
+ * @return
+ */
+//*****************************************************************************
+const char *FauxMoTrace::stageName( Stage stage )
+{
+    switch ( stage )
+    {
+        case SsdpReceive:  return "ssdp_receive";
+        case SsdpResponse: return "ssdp_response";
+        case TcpAccept:    return "tcp_accept";
+        case TcpData:      return "tcp_data";
+        case Handler:      return "handler";
+        case TcpWrite:     return "tcp_write";
+        default:           return "unknown";
+    }
+}
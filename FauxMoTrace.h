@@ -0,0 +1,109 @@
+#ifndef FAUXMOTRACE_H
+#define FAUXMOTRACE_H
+
+#include "FauxMoLib_global.h"
+
+#include <QByteArray>
+#include <QString>
+
+#include <atomic>
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief The FauxMoTrace class - records how long each request stage takes
+ *        into a fixed-size ring per thread, dumped as Chrome trace-event JSON
+ *        (load in chrome://tracing or ui.perfetto.dev)
+ */
+//*****************************************************************************
+class FAUXMOLIB_EXPORT FauxMoTrace
+{
+public:
+
+    //*** request stages ***
+    enum Stage
+    {
+        SsdpReceive = 0,    // readPendingDatagrams, one datagram
+        SsdpResponse,       // sendUDPResponse
+        TcpAccept,          // newTcpConnection, one socket
+        TcpData,            // connectionReadyRead
+        Handler,            // setup/event/metainfo/action handler
+        TcpWrite,           // response write
+        StageCount
+    };
+
+    //*** the one branch taken when tracing is off ***
+    static bool enabled() { return enabled_.load( std::memory_order_relaxed ); }
+
+    static void setEnabled( bool en ) { enabled_.store( en ); }
+
+    //*** monotonic time in microseconds ***
+    static qint64 nowUs();
+
+    //*** adds a completed stage to this thread's ring ***
+    static void record( Stage stage, quint64 id, qint64 startUs, qint64 endUs );
+
+    //*** all rings as Chrome trace-event JSON ***
+    static QByteArray toChromeJson();
+
+    //*** writes toChromeJson() to a file ***
+    static bool dump( const QString &fileName );
+
+    //*** empties all rings ***
+    static void clear();
+
+    //*** stage names ***
+    static const char *stageName( Stage stage );
+
+
+private:
+
+    static std::atomic<bool> enabled_;
+};
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief The FauxMoTraceScope class - records a stage from construction to
+ *        destruction. The id ties stages of one request together, it comes
+ *        from a functor so it is only worked out when tracing is on. Use
+ *        FAUXMO_TRACE rather than the class.
+ */
+//*****************************************************************************
+class FauxMoTraceScope
+{
+public:
+
+    template <typename IdFn>
+    FauxMoTraceScope( FauxMoTrace::Stage stage, IdFn idFn )
+        : stage_(stage), id_(0), startUs_(-1)
+    {
+        if ( Q_UNLIKELY( FauxMoTrace::enabled() ) )
+        {
+            id_      = idFn();
+            startUs_ = FauxMoTrace::nowUs();
+        }
+    }
+
+    ~FauxMoTraceScope()
+    {
+        if ( Q_UNLIKELY( startUs_ >= 0 ) )
+            FauxMoTrace::record( stage_, id_, startUs_, FauxMoTrace::nowUs() );
+    }
+
+private:
+
+    Q_DISABLE_COPY( FauxMoTraceScope )
+
+    FauxMoTrace::Stage stage_;
+    quint64 id_;
+    qint64  startUs_;
+};
+
+
+//*** trace the rest of the scope as var - id is not evaluated unless tracing ***
+#define FAUXMO_TRACE( var, stage, id ) \
+    FauxMoTraceScope var( FauxMoTrace::stage, [&]() -> quint64 { return quint64( id ); } )
+
+#endif // FAUXMOTRACE_H
@@ -16,6 +16,15 @@ const char UDP_RESPONSE_TEMPLATE[] =
     "\r\n";
 
 
+const char UDP_BYEBYE_TEMPLATE[] =
+    "NOTIFY * HTTP/1.1\r\n"
+    "HOST: 239.255.255.250:1900\r\n"
+    "NT: %1\r\n"
+    "NTS: ssdp:byebye\r\n"
+    "USN: uuid:Socket-1_0-%2::%1\r\n"
+    "\r\n";
+
+
 const char HTTP_HEADER[] =
         "HTTP/1.1 200 OK\r\n"
         "CONTENT-LENGTH: %1\r\n"
@@ -139,3 +148,46 @@ const char SOAP_RESPONSE[] =
         "</u:%1%2Response>"
     "</s:Body>"
 "</s:Envelope>";
+
+
+//*** Hue bridge emulation ***
+
+const char HUE_UDP_RESPONSE_TEMPLATE[] =
+    "HTTP/1.1 200 OK\r\n"
+    "HOST: 239.255.255.250:1900\r\n"
+    "CACHE-CONTROL: max-age=100\r\n"
+    "EXT:\r\n"
+    "LOCATION: http://%1/description.xml\r\n"
+    "SERVER: Linux/3.14.0 UPnP/1.0 IpBridge/1.17.0\r\n"
+    "hue-bridgeid: %2\r\n"
+    "ST: urn:schemas-upnp-org:device:basic:1\r\n"
+    "USN: uuid:2f402f80-da50-11e1-9b23-%3::upnp:rootdevice\r\n"
+    "\r\n";
+
+
+const char HTTP_HEADER_JSON[] =
+        "HTTP/1.1 200 OK\r\n"
+        "CONTENT-LENGTH: %1\r\n"
+        "CONTENT-TYPE: application/json\r\n"
+        "DATE: %2\r\n"
+        "SERVER: Linux/3.14.0 UPnP/1.0 IpBridge/1.17.0\r\n"
+        "CONNECTION: close\r\n\r\n";
+
+
+const char HUE_DESCRIPTION_XML[] =
+"<?xml version=\"1.0\" ?>"
+"<root xmlns=\"urn:schemas-upnp-org:device-1-0\">"
+    "<specVersion><major>1</major><minor>0</minor></specVersion>"
+    "<URLBase>http://%1/</URLBase>"
+    "<device>"
+        "<deviceType>urn:schemas-upnp-org:device:Basic:1</deviceType>"
+        "<friendlyName>Philips hue (%1)</friendlyName>"
+        "<manufacturer>Royal Philips Electronics</manufacturer>"
+        "<manufacturerURL>http://www.philips.com</manufacturerURL>"
+        "<modelDescription>Philips hue Personal Wireless Lighting</modelDescription>"
+        "<modelName>Philips hue bridge 2012</modelName>"
+        "<modelNumber>929000226503</modelNumber>"
+        "<serialNumber>%2</serialNumber>"
+        "<UDN>uuid:2f402f80-da50-11e1-9b23-%2</UDN>"
+    "</device>"
+"</root>";
@@ -0,0 +1,446 @@
+#include "HueBridge.h"
+#include "FauxMo_Templates.h"
+#include "FauxMoLog.h"
+#include "FauxMoTrace.h"
+#include "FauxMoCapture.h"
+
+#include <QJsonDocument>
+#include <QJsonArray>
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief HueBridge::HueBridge
+ * @param port
+ * @param mac - MAC address of the primary interface, used for the ids
+ * @param guard - shared connection admission control
+ * @param pool - shared recycled client connections
+ * @param watchdog - shared stall watchdog
+ * @param parent
+ */
+//*****************************************************************************
+HueBridge::HueBridge( quint16 port, QString mac, ConnectionGuard *guard, ConnectionPool *pool,
+                      LoopWatchdog *watchdog, QObject *parent )
+    : QObject(parent),
+      port_(port),
+      guard_(guard),
+      pool_(pool),
+      watchdog_(watchdog)
+{
+    //*** bridge id is the MAC with FFFE in the middle ***
+    mac_      = mac.toLower().remove( ":" ).leftJustified( 12, '0', true );
+    bridgeId_ = ( mac_.left( 6 ) + "fffe" + mac_.mid( 6 ) ).toUpper();
+
+    //*** create a new TCP server - client sockets come from the pool ***
+    tcpServer_ = new PooledTcpServer( pool_, this, this );
+
+    //*** connect to 'new client handler' ***
+    connect( tcpServer_, SIGNAL(newConnection()), SLOT(newTcpConnection()) );
+}
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief HueBridge::~HueBridge
+ */
+//*****************************************************************************
+HueBridge::~HueBridge()
+{
+    //*** drop connections still open to us ***
+    pool_->detach( this );
+
+    //*** close down TCP server ***
+    delete tcpServer_;
+}
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief HueBridge::listen
+ * @return
+ */
+//*****************************************************************************
+bool HueBridge::listen()
+{
+    if ( !tcpServer_->listen( QHostAddress::Any, port_ ) )
+    {
+        FAUXMO_LOG( Device, Error, "Hue", "Error listening on TCP port %u", unsigned(port_) );
+        return false;
+    }
+
+    return true;
+}
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief HueBridge::addLight
+ * @param dev
+ */
+//*****************************************************************************
+void HueBridge::addLight( WemoDevice *dev )
+{
+quint32 hash = 2166136261u;
+
+    if ( lightIds_.contains( dev ) ) return;
+
+    //*** id from FNV-1a of the uuid, so it doesn't depend on add order - it
+    //*** survives restarts only when the uuid is fixed in the config ***
+    QByteArray uuid = dev->getUuid().toUtf8();
+    for ( int i = 0; i < uuid.size(); i++ )
+    {
+        hash ^= quint8( uuid[i] );
+        hash *= 16777619u;
+    }
+
+    int id = int( hash % HUE_LIGHT_ID_RANGE ) + 1;
+
+    //*** collisions take the next free id ***
+    while ( lights_.contains( id ) )
+        id = id % int(HUE_LIGHT_ID_RANGE) + 1;
+
+    lights_.insert( id, dev );
+    lightIds_.insert( dev, id );
+}
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief HueBridge::removeLight
+ * @param dev
+ */
+//*****************************************************************************
+void HueBridge::removeLight( WemoDevice *dev )
+{
+    if ( !lightIds_.contains( dev ) ) return;
+
+    lights_.remove( lightIds_.take( dev ) );
+}
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief HueBridge::ssdpResponse
+ * @param local
+ * @return
+ */
+//*****************************************************************************
+QByteArray HueBridge::ssdpResponse( const QHostAddress &local )
+{
+    QString point = local.toString() + ":" + QString::number( port_ );
+
+    return QString( HUE_UDP_RESPONSE_TEMPLATE ).arg( point ).arg( bridgeId_ ).arg( mac_ ).toUtf8();
+}
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief HueBridge::newTcpConnection
+ */
+//*****************************************************************************
+void HueBridge::newTcpConnection()
+{
+    FauxMoLogScope logScope( pool_->parent() );
+
+    while ( tcpServer_->hasPendingConnections() )
+    {
+        //*** get socket for new connection ***
+        QTcpSocket *clientSock = tcpServer_->nextPendingConnection();
+
+        FAUXMO_TRACE( trace, TcpAccept, quintptr(clientSock) );
+
+        //*** check connection limits - rejected sockets are aborted ***
+        guard_->admit( clientSock, this );
+    }
+}
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief HueBridge::connectionError
+ * @param conn
+ */
+//*****************************************************************************
+void HueBridge::connectionError( PooledConnection *conn )
+{
+    FAUXMO_LOG( Connection, Warning, "Hue", "Client socket error: %s",
+                qPrintable( conn->sock->errorString() ) );
+}
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief HueBridge::connectionReadyRead
+ * @param conn
+ */
+//*****************************************************************************
+void HueBridge::connectionReadyRead( PooledConnection *conn )
+{
+QByteArray msgOut;
+int size = 0;
+
+    QTcpSocket *sock = conn->sock;
+
+    FAUXMO_TRACE( trace, TcpData, quintptr(sock) );
+    WatchdogScope watch( watchdog_, LoopWatchdog::DeviceRequest );
+
+    //*** read until we have a full request (limits enforced by guard) ***
+    if ( guard_->readRequest( sock, conn->request, size ) != ConnectionGuard::Complete ) return;
+
+    //*** one request per connection - anything pipelined behind it is dropped ***
+    conn->request.resize( size );
+    const QByteArray &request = conn->request;
+
+    //*** traffic capture for replay ***
+    if ( FauxMoCapture::enabled() )
+        FauxMoCapture::record( FauxMoCapture::Http, sock->peerAddress().toIPv4Address(), sock->peerPort(), sock->localPort(),
+                               request.constData(), size );
+
+    //*** request line: METHOD PATH HTTP/1.1 ***
+    int lineEnd = request.indexOf( "\r\n" );
+    QList<QByteArray> requestLine = request.left( lineEnd ).split( ' ' );
+    if ( requestLine.size() < 2 ) return;
+
+    QByteArray method = requestLine[0];
+    QByteArray path   = requestLine[1];
+    QByteArray body   = request.mid( request.indexOf( "\r\n\r\n" ) + 4 );
+
+    //*** /api/<user>/lights/<id>/state ***
+    QList<QByteArray> parts = path.split( '/' );
+
+    {
+        FAUXMO_TRACE( handlerTrace, Handler, quintptr(sock) );
+
+        if ( path == "/description.xml" )
+            msgOut = createMsg( handleDescription( sock ), HTTP_HEADER );
+        else if ( method == "POST" && ( path == "/api" || path == "/api/" ) )
+            msgOut = createMsg( handleCreateUser(), HTTP_HEADER_JSON );
+        else if ( parts.size() == 4 && parts[1] == "api" && parts[3] == "lights" )
+            msgOut = createMsg( handleLights(), HTTP_HEADER_JSON );
+        else if ( parts.size() == 5 && parts[1] == "api" && parts[3] == "lights" )
+            msgOut = createMsg( handleLight( parts[4].toInt() ), HTTP_HEADER_JSON );
+        else if ( method == "PUT" && parts.size() == 6 && parts[1] == "api" && parts[3] == "lights" && parts[5] == "state" )
+            msgOut = createMsg( handleSetState( parts[4].toInt(), body ), HTTP_HEADER_JSON );
+        else
+            msgOut = createMsg( handleUnknown( path ), HTTP_HEADER_JSON );
+    }
+
+    //*** send the message ***
+    {
+        FAUXMO_TRACE( writeTrace, TcpWrite, quintptr(sock) );
+        sock->write( msgOut );
+    }
+
+    pool_->requestDone( conn );
+
+    //*** we advertise 'CONNECTION: close' - close once the response is flushed ***
+    sock->disconnectFromHost();
+}
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief HueBridge::handleDescription - advertises the address the client
+ *        connected to
+ * @param sock
+ * @return
+ */
+//*****************************************************************************
+QByteArray HueBridge::handleDescription( QTcpSocket *sock )
+{
+    QString point = sock->localAddress().toString() + ":" + QString::number( port_ );
+
+    return QString( HUE_DESCRIPTION_XML ).arg( point ).arg( mac_ ).toUtf8();
+}
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief HueBridge::handleCreateUser - every pairing request succeeds
+ * @return
+ */
+//*****************************************************************************
+QByteArray HueBridge::handleCreateUser()
+{
+    return "[{\"success\":{\"username\":\"" + mac_.toUtf8() + "\"}}]";
+}
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief HueBridge::handleLights - all lights, keyed by id
+ * @return
+ */
+//*****************************************************************************
+QByteArray HueBridge::handleLights()
+{
+QJsonObject all;
+
+    for ( auto it = lights_.constBegin(); it != lights_.constEnd(); ++it )
+        all.insert( QString::number( it.key() ), lightJson( it.value() ) );
+
+    return QJsonDocument( all ).toJson( QJsonDocument::Compact );
+}
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief HueBridge::handleLight
+ * @param id
+ * @return
+ */
+//*****************************************************************************
+QByteArray HueBridge::handleLight( int id )
+{
+    WemoDevice *dev = lights_.value( id );
+    if ( !dev ) return handleUnknown( "/lights/" + QByteArray::number( id ) );
+
+    return QJsonDocument( lightJson( dev ) ).toJson( QJsonDocument::Compact );
+}
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief HueBridge::handleSetState - {"on":bool} or {"bri":n}, bri 0 is off
+ * @param id
+ * @param body
+ * @return
+ */
+//*****************************************************************************
+QByteArray HueBridge::handleSetState( int id, const QByteArray &body )
+{
+QJsonArray result;
+
+    WemoDevice *dev = lights_.value( id );
+    if ( !dev ) return handleUnknown( "/lights/" + QByteArray::number( id ) );
+
+    QJsonObject req = QJsonDocument::fromJson( body ).object();
+    QString base = "/lights/" + QString::number( id ) + "/state/";
+
+    bool state = dev->getState();
+
+    if ( req.contains( "on" ) )
+        state = req.value( "on" ).toBool();
+    else if ( req.contains( "bri" ) )
+        state = req.value( "bri" ).toInt() > 0;
+    else
+    {
+        FAUXMO_LOG( Device, Warning, dev->getName(), "Invalid Hue state msg" );
+        return handleUnknown( base.toUtf8() );
+    }
+
+    //*** echo each attribute back as a success ***
+    for ( auto it = req.constBegin(); it != req.constEnd(); ++it )
+    {
+        QJsonObject ok;
+        ok.insert( base + it.key(), it.value() );
+
+        QJsonObject entry;
+        entry.insert( "success", ok );
+        result.append( entry );
+    }
+
+    //*** set our current state ***
+    dev->setCurrentState( state );
+
+    //*** let parent program handle new state ***
+    {
+        WatchdogScope watch( watchdog_, LoopWatchdog::AppHandler );
+        emit setDeviceState( dev->getName(), state );
+    }
+
+    return QJsonDocument( result ).toJson( QJsonDocument::Compact );
+}
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief HueBridge::handleUnknown - Hue style 'resource not available'
+ * @param path
+ * @return
+ */
+//*****************************************************************************
+QByteArray HueBridge::handleUnknown( const QByteArray &path )
+{
+    FAUXMO_LOG( Device, Debug, "Hue", "Unknown request %s", path.constData() );
+
+    QJsonObject err;
+    err.insert( "type", 3 );
+    err.insert( "address", QString::fromUtf8( path ) );
+    err.insert( "description", "resource, " + QString::fromUtf8( path ) + ", not available" );
+
+    QJsonObject entry;
+    entry.insert( "error", err );
+
+    return QJsonDocument( QJsonArray() << entry ).toJson( QJsonDocument::Compact );
+}
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief HueBridge::lightJson - a dimmable light, bri follows on/off
+ * @param dev
+ * @return
+ */
+//*****************************************************************************
+QJsonObject HueBridge::lightJson( WemoDevice *dev )
+{
+QJsonObject state;
+QJsonObject light;
+
+    state.insert( "on", dev->getState() );
+    state.insert( "bri", dev->getState() ? 254 : 0 );
+    state.insert( "alert", "none" );
+    state.insert( "reachable", true );
+
+    light.insert( "state", state );
+    light.insert( "type", "Dimmable light" );
+    light.insert( "name", dev->getName() );
+    light.insert( "modelid", "LWB010" );
+    light.insert( "manufacturername", "Philips" );
+    light.insert( "swversion", "1.15.0_r18729" );
+
+    //*** unique id from the device uuid - stable across restarts only when
+    //*** the uuid is fixed in the config, otherwise it's new every process ***
+    QString uid = dev->getUuid().toLower().remove( "-" ).leftJustified( 16, '0', true );
+    QString uniqueId;
+    for ( int i = 0; i < 16; i += 2 )
+        uniqueId += ( i ? ":" : "" ) + uid.mid( i, 2 );
+    light.insert( "uniqueid", uniqueId + "-0b" );
+
+    return light;
+}
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief HueBridge::createMsg
+ * @param body
+ * @param headerTemplate - HTTP_HEADER or HTTP_HEADER_JSON
+ * @return
+ */
+//*****************************************************************************
+QByteArray HueBridge::createMsg( const QByteArray &body, const char *headerTemplate )
+{
+    //*** create header from template ***
+    QString hdr = QString( headerTemplate ).arg( body.size() ).arg( timeStr() );
+
+    //*** combine header and body ***
+    return hdr.toUtf8() + body;
+}
@@ -0,0 +1,117 @@
+#ifndef HUEBRIDGE_H
+#define HUEBRIDGE_H
+
+#include <QObject>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QDateTime>
+#include <QHash>
+#include <QMap>
+#include <QAbstractSocket>
+#include <QJsonObject>
+
+#include "ConnectionGuard.h"
+#include "ConnectionPool.h"
+#include "LoopWatchdog.h"
+#include "WemoDevice.h"
+
+//*** light ids are 1 .. HUE_LIGHT_ID_RANGE ***
+const quint32 HUE_LIGHT_ID_RANGE = 9999;
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief The HueBridge class - presents every device as a light behind one
+ *        emulated Philips Hue bridge: one discovery response, one
+ *        description.xml and a JSON /api/<user>/lights endpoint
+ */
+//*****************************************************************************
+class HueBridge : public QObject, public ConnectionHandler
+{
+    Q_OBJECT
+
+public:
+
+    //*** constructor ***
+    explicit HueBridge( quint16 port, QString mac, ConnectionGuard *guard, ConnectionPool *pool,
+                        LoopWatchdog *watchdog, QObject *parent = nullptr );
+
+    //*** destructor ***
+    ~HueBridge();
+
+    //*** starts serving on our port ***
+    bool listen();
+
+    //*** lights - the device keeps holding name and state, id and uniqueid
+    //*** come from its uuid (give devices fixed uuids in the config) ***
+    void addLight( WemoDevice *dev );
+    void removeLight( WemoDevice *dev );
+
+    //*** discovery response advertising the given local address ***
+    QByteArray ssdpResponse( const QHostAddress &local );
+
+    //*** return bridge info ***
+    quint16 getPort() { return port_; }
+    QString getBridgeId() { return bridgeId_; }
+
+    //*** ConnectionHandler - called by the pool for our connections ***
+    void connectionReadyRead( PooledConnection *conn ) override;
+    void connectionError( PooledConnection *conn ) override;
+
+
+signals:
+
+    //*** announce device state set by Alexa ***
+    void setDeviceState( QString devName, bool state );
+
+
+private slots:
+
+    //*** called when there is a new TCP connection ***
+    void newTcpConnection();
+
+
+private:
+
+    //*** returns current time/date in correct format ***
+    QString timeStr() { return QDateTime::currentDateTime().toString( Qt::RFC2822Date ); }
+
+    //*** handlers for the different requests ***
+    QByteArray handleDescription( QTcpSocket *sock );
+    QByteArray handleCreateUser();
+    QByteArray handleLights();
+    QByteArray handleLight( int id );
+    QByteArray handleSetState( int id, const QByteArray &body );
+    QByteArray handleUnknown( const QByteArray &path );
+
+    //*** one light as a JSON object ***
+    QJsonObject lightJson( WemoDevice *dev );
+
+    //*** adds http header to body to create full message ***
+    QByteArray createMsg( const QByteArray &body, const char *headerTemplate );
+
+    //*** unique port for the bridge ***
+    quint16 port_;
+
+    //*** ids derived from the MAC address ***
+    QString mac_;
+    QString bridgeId_;
+
+    //*** lights by id, ids by device ***
+    QMap<int,WemoDevice*> lights_;
+    QHash<WemoDevice*,int> lightIds_;
+
+    //*** TCP server for the bridge ***
+    QTcpServer *tcpServer_;
+
+    //*** shared admission control / deadlines ***
+    ConnectionGuard *guard_;
+
+    //*** shared recycled connections ***
+    ConnectionPool *pool_;
+
+    //*** shared stall watchdog ***
+    LoopWatchdog *watchdog_;
+};
+
+#endif // HUEBRIDGE_H
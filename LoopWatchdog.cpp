@@ -0,0 +1,184 @@
+#include "LoopWatchdog.h"
+
+//*** defaults ***
+const int DEFAULT_PROBE_INTERVAL_MS   = 100;
+const int DEFAULT_STALL_THRESHOLD_MS  = 250;
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief LatencyHistogram::add
+ * @param us
+ */
+//*****************************************************************************
+void LatencyHistogram::add( qint64 us )
+{
+int bucket = 0;
+
+    if ( us < 0 ) us = 0;
+
+    //*** bucket = number of significant bits ***
+    for ( qint64 v = us; v > 0 && bucket < LATENCY_BUCKETS - 1; v >>= 1 )
+        bucket++;
+
+    buckets[bucket]++;
+    count++;
+    totalUs += us;
+    if ( us > maxUs ) maxUs = us;
+}
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief LatencyHistogram::percentileUs
+ * @param pct
+ * @return
+ */
+//*****************************************************************************
+qint64 LatencyHistogram::percentileUs( double pct ) const
+{
+    if ( count == 0 ) return 0;
+
+    quint64 target = quint64( ( pct / 100.0 ) * double(count) + 0.5 );
+    if ( target < 1 ) target = 1;
+
+    quint64 seen = 0;
+    for ( int i = 0; i < LATENCY_BUCKETS; i++ )
+    {
+        seen += buckets[i];
+        if ( seen >= target )
+            return qMin( i ? ( qint64(1) << i ) - 1 : 0, maxUs );
+    }
+
+    return maxUs;
+}
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief LoopWatchdog::LoopWatchdog
+ * @param parent
+ */
+//*****************************************************************************
+LoopWatchdog::LoopWatchdog( QObject *parent )
+    : QObject(parent),
+      enabled_(false),
+      active_(nullptr),
+      stallThresholdUs_( qint64(DEFAULT_STALL_THRESHOLD_MS) * 1000 ),
+      lastProbeUs_(0),
+      worstSinceProbeUs_(0)
+{
+    //*** precise timer - coarse timers are allowed 5% slack ***
+    probe_.setTimerType( Qt::PreciseTimer );
+    probe_.setInterval( DEFAULT_PROBE_INTERVAL_MS );
+    connect( &probe_, SIGNAL(timeout()), SLOT(probe()) );
+
+    clock_.start();
+}
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief LoopWatchdog::setEnabled
+ * @param en
+ */
+//*****************************************************************************
+void LoopWatchdog::setEnabled( bool en )
+{
+    enabled_ = en;
+
+    if ( en )
+    {
+        lastProbeUs_       = nowUs();
+        worstSinceProbeUs_ = 0;
+        probe_.start();
+    }
+    else
+    {
+        probe_.stop();
+    }
+}
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief LoopWatchdog::reset
+ */
+//*****************************************************************************
+void LoopWatchdog::reset()
+{
+    for ( int i = 0; i < PhaseCount; i++ )
+        histograms_[i] = LatencyHistogram();
+}
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief LoopWatchdog::phaseDone - records a phase run
+ * @param phase
+ * @param durationUs - own time, nested phases excluded
+ */
+//*****************************************************************************
+void LoopWatchdog::phaseDone( Phase phase, qint64 durationUs )
+{
+    histograms_[phase].add( durationUs );
+
+    //*** own time - if no single phase crossed the threshold the probe
+    //*** reports the lag instead ***
+    if ( durationUs > worstSinceProbeUs_ ) worstSinceProbeUs_ = durationUs;
+
+    if ( durationUs >= stallThresholdUs_ )
+        emit stallDetected( phaseName( phase ), durationUs / 1000 );
+}
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief LoopWatchdog::probe - lag is how late the timer fired
+ */
+//*****************************************************************************
+void LoopWatchdog::probe()
+{
+    qint64 now = nowUs();
+    qint64 lag = now - lastProbeUs_ - qint64( probe_.interval() ) * 1000;
+    if ( lag < 0 ) lag = 0;
+
+    lastProbeUs_ = now;
+
+    histograms_[EventLoop].add( lag );
+
+    //*** a phase we time already reported this one - otherwise the time went
+    //*** to something outside the library (other host slots, timers, ...) ***
+    if ( lag >= stallThresholdUs_ && worstSinceProbeUs_ < stallThresholdUs_ )
+        emit stallDetected( phaseName( EventLoop ), lag / 1000 );
+
+    worstSinceProbeUs_ = 0;
+}
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief LoopWatchdog::phaseName
+ * @param phase
+ * @return
+ */
+//*****************************************************************************
+QString LoopWatchdog::phaseName( Phase phase )
+{
+    switch ( phase )
+    {
+        case EventLoop:     return "EventLoop";
+        case Discovery:     return "Discovery";
+        case DeviceRequest: return "DeviceRequest";
+        case AppHandler:    return "AppHandler";
+        default:            return "Unknown";
+    }
+}
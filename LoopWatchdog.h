@@ -0,0 +1,178 @@
+#ifndef LOOPWATCHDOG_H
+#define LOOPWATCHDOG_H
+
+#include "FauxMoLib_global.h"
+
+#include <QObject>
+#include <QTimer>
+#include <QElapsedTimer>
+#include <QString>
+
+//*** log2 microsecond buckets - last bucket is ~8s and above ***
+const int LATENCY_BUCKETS = 24;
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief The LatencyHistogram struct - bucket i counts samples in
+ *        [2^(i-1), 2^i) microseconds
+ */
+//*****************************************************************************
+struct FAUXMOLIB_EXPORT LatencyHistogram
+{
+    quint64 buckets[LATENCY_BUCKETS] = {};
+    quint64 count = 0;
+    qint64  maxUs = 0;
+    qint64  totalUs = 0;
+
+    //*** adds a sample ***
+    void add( qint64 us );
+
+    //*** upper bound of the bucket holding the given percentile (0-100) ***
+    qint64 percentileUs( double pct ) const;
+
+    //*** mean in microseconds ***
+    qint64 meanUs() const { return count ? totalUs / qint64(count) : 0; }
+};
+
+
+class WatchdogScope;
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief The LoopWatchdog class - measures event loop lag with a probe timer
+ *        and the run time of each processing phase, and reports stalls
+ */
+//*****************************************************************************
+class LoopWatchdog : public QObject
+{
+    Q_OBJECT
+
+public:
+
+    //*** what was running ***
+    enum Phase
+    {
+        EventLoop = 0,      // probe timer fired late
+        Discovery,          // SSDP datagram handling
+        DeviceRequest,      // device HTTP request handling
+        AppHandler,         // host slots connected to setDeviceState
+        PhaseCount
+    };
+
+    //*** constructor ***
+    explicit LoopWatchdog( QObject *parent = nullptr );
+
+    //*** starts/stops the probe and phase timing ***
+    void setEnabled( bool en );
+    bool isEnabled() const { return enabled_; }
+
+    //*** lag or run time that counts as a stall ***
+    void setStallThreshold( int ms ) { stallThresholdUs_ = qint64(ms) * 1000; }
+
+    //*** probe period ***
+    void setProbeInterval( int ms ) { probe_.setInterval( ms ); }
+
+    //*** histogram for a phase ***
+    LatencyHistogram histogram( Phase phase ) const { return histograms_[phase]; }
+
+    //*** clears histograms ***
+    void reset();
+
+    //*** called by WatchdogScope - durationUs excludes nested phases ***
+    qint64 nowUs() const { return clock_.nsecsElapsed() / 1000; }
+    void phaseDone( Phase phase, qint64 durationUs );
+
+    //*** names for display ***
+    static QString phaseName( Phase phase );
+
+
+signals:
+
+    //*** a phase ran, or the loop lagged, longer than the threshold ***
+    void stallDetected( QString phase, qint64 durationMs );
+
+
+private slots:
+
+    //*** probe timer ***
+    void probe();
+
+
+private:
+
+    friend class WatchdogScope;
+
+    bool enabled_;
+
+    //*** innermost phase running, nullptr between phases ***
+    WatchdogScope *active_;
+
+    qint64 stallThresholdUs_;
+
+    QTimer probe_;
+    QElapsedTimer clock_;
+    qint64 lastProbeUs_;
+
+    //*** longest phase run since the last probe ***
+    qint64 worstSinceProbeUs_;
+
+    LatencyHistogram histograms_[PhaseCount];
+};
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief The WatchdogScope class - times a phase from construction to
+ *        destruction, does nothing if the watchdog is off. Scopes nest (a
+ *        device request runs the host's handler) - time spent in an inner
+ *        phase is reported there and left out of the outer one, so one slow
+ *        slot is reported once.
+ */
+//*****************************************************************************
+class WatchdogScope
+{
+public:
+
+    WatchdogScope( LoopWatchdog *dog, LoopWatchdog::Phase phase )
+        : dog_( ( dog && dog->isEnabled() ) ? dog : nullptr ),
+          phase_(phase),
+          startUs_( dog_ ? dog_->nowUs() : 0 ),
+          nestedUs_(0),
+          outer_(nullptr)
+    {
+        if ( dog_ )
+        {
+            outer_ = dog_->active_;
+            dog_->active_ = this;
+        }
+    }
+
+    ~WatchdogScope()
+    {
+        if ( !dog_ ) return;
+
+        qint64 totalUs = dog_->nowUs() - startUs_;
+
+        dog_->active_ = outer_;
+        if ( outer_ ) outer_->nestedUs_ += totalUs;
+
+        dog_->phaseDone( phase_, totalUs - nestedUs_ );
+    }
+
+private:
+
+    Q_DISABLE_COPY( WatchdogScope )
+
+    LoopWatchdog *dog_;
+    LoopWatchdog::Phase phase_;
+    qint64 startUs_;
+
+    //*** time spent in phases nested inside this one ***
+    qint64 nestedUs_;
+    WatchdogScope *outer_;
+};
+
+#endif // LOOPWATCHDOG_H
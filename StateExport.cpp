@@ -0,0 +1,364 @@
+#include "StateExport.h"
+#include "FauxMoLog.h"
+
+#include <QDateTime>
+
+#if defined(Q_OS_UNIX)
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <climits>
+#include <cerrno>
+#endif
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief StateExport::StateExport
+ */
+//*****************************************************************************
+StateExport::StateExport()
+    : fd_(-1),
+      table_(nullptr),
+      size_(0),
+      capacity_(0),
+      nextSlot_(0),
+      nextDeviceId_(1)
+{
+}
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief StateExport::~StateExport
+ */
+//*****************************************************************************
+StateExport::~StateExport()
+{
+    close();
+}
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief StateExport::open
+ * @param shmName - POSIX shm name, e.g. "/fauxmo-state"
+ * @param capacity - max devices
+ * @param replaceStale - unlink an existing table of the same name first
+ * @return - false if the name is taken (and not replaceStale) or on error
+ */
+//*****************************************************************************
+bool StateExport::open( QString shmName, int capacity, bool replaceStale )
+{
+#if defined(Q_OS_UNIX)
+    if ( table_ || capacity < 1 ) return false;
+
+    size_t entryOffset = sizeof(FauxMoShmHeader);
+    size_t namesOffset = entryOffset + size_t(capacity) * sizeof(FauxMoShmEntry);
+    size_t size        = namesOffset + size_t(capacity) * FAUXMO_SHM_NAME_SIZE;
+
+    QByteArray name = shmName.toUtf8();
+
+    //*** only on request - the name may belong to a live process ***
+    if ( replaceStale ) shm_unlink( name.constData() );
+
+    int fd = shm_open( name.constData(), O_CREAT | O_EXCL | O_RDWR, 0644 );
+    if ( fd < 0 && errno == EEXIST )
+    {
+        FAUXMO_LOG( General, Error, "", "Shared memory %s exists - in use by another process, "
+                    "or left by a crashed run (replace it with replaceStale)", name.constData() );
+        return false;
+    }
+
+    if ( fd < 0 )
+    {
+        FAUXMO_LOG( General, Error, "", "shm_open %s failed", name.constData() );
+        return false;
+    }
+
+    if ( ftruncate( fd, off_t(size) ) < 0 )
+    {
+        FAUXMO_LOG( General, Error, "", "Can't size shared memory %s", name.constData() );
+        ::close( fd );
+        shm_unlink( name.constData() );
+        return false;
+    }
+
+    void *table = mmap( nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0 );
+    if ( table == MAP_FAILED )
+    {
+        FAUXMO_LOG( General, Error, "", "Can't map shared memory %s", name.constData() );
+        ::close( fd );
+        shm_unlink( name.constData() );
+        return false;
+    }
+
+    shmName_  = shmName;
+    fd_       = fd;
+    table_    = table;
+    size_     = size;
+    capacity_ = capacity;
+
+    //*** new shm is zero filled - fill in the layout, magic last ***
+    FauxMoShmHeader *hdr = header();
+    hdr->version     = FAUXMO_SHM_VERSION;
+    hdr->capacity    = quint32(capacity);
+    hdr->entrySize   = sizeof(FauxMoShmEntry);
+    hdr->entryOffset = quint32(entryOffset);
+    hdr->namesOffset = quint32(namesOffset);
+
+    for ( int i = 0; i < capacity; i++ )
+        entry( i )->nameOffset = quint32( namesOffset + size_t(i) * FAUXMO_SHM_NAME_SIZE );
+
+    __atomic_store_n( &hdr->magic, FAUXMO_SHM_MAGIC, __ATOMIC_RELEASE );
+
+    return true;
+#else
+    Q_UNUSED( shmName );
+    Q_UNUSED( capacity );
+    FAUXMO_LOG( General, Error, "", "Shared memory state export is not supported on this platform" );
+    return false;
+#endif
+}
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief StateExport::close
+ */
+//*****************************************************************************
+void StateExport::close()
+{
+#if defined(Q_OS_UNIX)
+    if ( !table_ ) return;
+
+    munmap( table_, size_ );
+    ::close( fd_ );
+    shm_unlink( shmName_.toUtf8().constData() );
+#endif
+
+    table_ = nullptr;
+    fd_    = -1;
+    freeSlots_.clear();
+    nextSlot_ = 0;
+}
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief StateExport::addDevice
+ * @param name
+ * @param state
+ * @return
+ */
+//*****************************************************************************
+int StateExport::addDevice( QString name, bool state )
+{
+int slot = -1;
+
+    if ( !table_ ) return -1;
+
+    //*** reuse a freed entry first ***
+    if ( !freeSlots_.isEmpty() )
+        slot = freeSlots_.takeFirst();
+    else if ( nextSlot_ < capacity_ )
+        slot = nextSlot_++;
+    else
+    {
+        FAUXMO_LOG( General, Warning, name, "Shared memory state table is full" );
+        return -1;
+    }
+
+    FauxMoShmEntry *e = entry( slot );
+
+    beginWrite( e );
+    e->deviceId     = nextDeviceId_++;
+    e->flags        = FAUXMO_SHM_IN_USE;
+    e->state        = state ? 1 : 0;
+    e->changeCount  = 0;
+    e->lastChangeMs = QDateTime::currentMSecsSinceEpoch();
+    writeName( slot, name );
+    endWrite( e );
+
+    changed();
+
+    return slot;
+}
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief StateExport::removeDevice
+ * @param slot
+ */
+//*****************************************************************************
+void StateExport::removeDevice( int slot )
+{
+    if ( !table_ || slot < 0 || slot >= capacity_ ) return;
+
+    FauxMoShmEntry *e = entry( slot );
+
+    beginWrite( e );
+    e->flags = 0;
+    writeName( slot, QString() );
+    endWrite( e );
+
+    freeSlots_.append( slot );
+
+    changed();
+}
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief StateExport::renameDevice
+ * @param slot
+ * @param name
+ */
+//*****************************************************************************
+void StateExport::renameDevice( int slot, QString name )
+{
+    if ( !table_ || slot < 0 || slot >= capacity_ ) return;
+
+    FauxMoShmEntry *e = entry( slot );
+
+    beginWrite( e );
+    writeName( slot, name );
+    endWrite( e );
+
+    changed();
+}
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief StateExport::publish
+ * @param slot
+ * @param state
+ */
+//*****************************************************************************
+void StateExport::publish( int slot, bool state )
+{
+    if ( !table_ || slot < 0 || slot >= capacity_ ) return;
+
+    FauxMoShmEntry *e = entry( slot );
+
+    beginWrite( e );
+    e->state        = state ? 1 : 0;
+    e->changeCount++;
+    e->lastChangeMs = QDateTime::currentMSecsSinceEpoch();
+    endWrite( e );
+
+    changed();
+}
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief StateExport::entry
+ * @param slot
+ * @return
+ */
+//*****************************************************************************
+FauxMoShmEntry *StateExport::entry( int slot )
+{
+    char *base = static_cast<char*>(table_) + sizeof(FauxMoShmHeader);
+
+    return reinterpret_cast<FauxMoShmEntry*>(base) + slot;
+}
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief StateExport::nameSlot
+ * @param slot
+ * @return
+ */
+//*****************************************************************************
+char *StateExport::nameSlot( int slot )
+{
+    return static_cast<char*>(table_) + header()->namesOffset + size_t(slot) * FAUXMO_SHM_NAME_SIZE;
+}
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief StateExport::writeName - truncated to fit, always NUL terminated
+ * @param slot
+ * @param name
+ */
+//*****************************************************************************
+void StateExport::writeName( int slot, QString name )
+{
+    qstrncpy( nameSlot( slot ), name.toUtf8().constData(), FAUXMO_SHM_NAME_SIZE );
+}
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief StateExport::beginWrite - seq goes odd
+ * @param e
+ */
+//*****************************************************************************
+void StateExport::beginWrite( FauxMoShmEntry *e )
+{
+#if defined(Q_OS_UNIX)
+    quint32 seq = e->seq;
+
+    __atomic_store_n( &e->seq, seq + 1, __ATOMIC_RELAXED );
+    __atomic_thread_fence( __ATOMIC_RELEASE );
+#else
+    Q_UNUSED( e );
+#endif
+}
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief StateExport::endWrite - seq goes even
+ * @param e
+ */
+//*****************************************************************************
+void StateExport::endWrite( FauxMoShmEntry *e )
+{
+#if defined(Q_OS_UNIX)
+    __atomic_store_n( &e->seq, e->seq + 1, __ATOMIC_RELEASE );
+#else
+    Q_UNUSED( e );
+#endif
+}
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief StateExport::changed - only makes a syscall if a reader is blocked
+ */
+//*****************************************************************************
+void StateExport::changed()
+{
+#if defined(Q_OS_UNIX)
+    FauxMoShmHeader *hdr = header();
+
+    __atomic_add_fetch( &hdr->changeSeq, 1u, __ATOMIC_SEQ_CST );
+
+#if defined(Q_OS_LINUX)
+    if ( __atomic_load_n( &hdr->waiters, __ATOMIC_SEQ_CST ) )
+        syscall( SYS_futex, &hdr->changeSeq, FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0 );
+#endif
+#endif
+}
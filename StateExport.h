@@ -0,0 +1,80 @@
+#ifndef STATEEXPORT_H
+#define STATEEXPORT_H
+
+#include <QString>
+#include <QList>
+
+#include "FauxMoShm.h"
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief The StateExport class - writes device states into a POSIX shared
+ *        memory table (layout in FauxMoShm.h) for other local processes
+ */
+//*****************************************************************************
+class StateExport
+{
+public:
+
+    //*** constructor ***
+    StateExport();
+
+    //*** destructor - unmaps and unlinks the table ***
+    ~StateExport();
+
+    //*** creates and maps the table - fails if the name exists unless
+    //*** replaceStale, for a table left behind by a crashed run ***
+    bool open( QString shmName, int capacity, bool replaceStale = false );
+
+    //*** unmaps and unlinks the table ***
+    void close();
+
+    bool isOpen() const { return table_ != nullptr; }
+
+    //*** takes an entry for a device, returns the slot or -1 if full ***
+    int addDevice( QString name, bool state );
+
+    //*** frees an entry ***
+    void removeDevice( int slot );
+
+    //*** replaces the name of an entry ***
+    void renameDevice( int slot, QString name );
+
+    //*** records a state change ***
+    void publish( int slot, bool state );
+
+
+private:
+
+    Q_DISABLE_COPY( StateExport )
+
+    //*** table pointers ***
+    FauxMoShmHeader *header() { return static_cast<FauxMoShmHeader*>(table_); }
+    FauxMoShmEntry *entry( int slot );
+    char *nameSlot( int slot );
+
+    //*** seqlock ***
+    void beginWrite( FauxMoShmEntry *e );
+    void endWrite( FauxMoShmEntry *e );
+
+    //*** copies a name into its slot ***
+    void writeName( int slot, QString name );
+
+    //*** bumps the change counter, wakes blocked readers ***
+    void changed();
+
+    QString shmName_;
+
+    int    fd_;
+    void  *table_;
+    size_t size_;
+
+    int capacity_;
+    int nextSlot_;
+    QList<int> freeSlots_;
+
+    quint32 nextDeviceId_;
+};
+
+#endif // STATEEXPORT_H
@@ -1,40 +1,63 @@
 #include "WemoDevice.h"
-#include "FauxMo_Templates.h"
+#include "FauxMoLog.h"
+#include "FauxMoTrace.h"
+#include "FauxMoCapture.h"
 
 #include <QTcpSocket>
 
+
 //*****************************************************************************
 //*****************************************************************************
 /**
  * @brief WemoDevice::WemoDevice
  * @param name
  * @param port
+ * @param guard - shared connection admission control
+ * @param pool - shared recycled client connections
+ * @param watchdog - shared stall watchdog
  * @param parent
  */
 //*****************************************************************************
-WemoDevice::WemoDevice( QString name, quint16 port, QObject *parent )
+WemoDevice::WemoDevice( QString name, quint16 port, ConnectionGuard *guard, ConnectionPool *pool,
+                        LoopWatchdog *watchdog, QObject *parent )
     : QObject(parent),
-      deviceName_(name),
-      port_(port)
+      protocol_( name, QUuid::createUuid().toString().remove("{").remove("}") ),
+      port_(port),
+      peerIp_(0),
+      peerPort_(0),
+      guard_(guard),
+      pool_(pool),
+      watchdog_(watchdog)
 {
-    //*** initialize state ***
-    state_ = false;
+    //*** not exported until setStateExport ***
+    stateExport_ = nullptr;
+    exportSlot_  = -1;
+
+    //*** create a new TCP server - client sockets come from the pool ***
+    tcpServer_ = new PooledTcpServer( pool_, this, this );
 
-    //*** create a new TCP server ***
-    tcpServer_ = new QTcpServer( this );
+    //*** connect to 'new client handler' ***
+    connect( tcpServer_, SIGNAL(newConnection()), SLOT(newTcpConnection()) );
+}
 
-    //*** create unique ID ***
-    uuid_ = QUuid::createUuid().toString().remove("{").remove("}");
 
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief WemoDevice::listen - starts serving the Wemo protocol on our port
+ * @return
+ */
+//*****************************************************************************
+bool WemoDevice::listen()
+{
     //*** start listening ***
     if ( !tcpServer_->listen( QHostAddress::Any, port_ ) )
     {
-        emit error( "Error listening on TCP port " + QString::number(port_) );
-        return;
+        FAUXMO_LOG( Device, Error, protocol_.name(), "Error listening on TCP port %u", unsigned(port_) );
+        return false;
     }
 
-    //*** connect to 'new client handler' ***
-    connect( tcpServer_, SIGNAL(newConnection()), SLOT(newTcpConnection()) );
+    return true;
 }
 
 
@@ -46,6 +69,9 @@ WemoDevice::WemoDevice( QString name, quint16 port, QObject *parent )
 //*****************************************************************************
 WemoDevice::~WemoDevice()
 {
+    //*** drop connections still open to us ***
+    pool_->detach( this );
+
     //*** close down TCP server ***
     delete tcpServer_;
 }
@@ -59,246 +85,137 @@ WemoDevice::~WemoDevice()
 //*****************************************************************************
 void WemoDevice::newTcpConnection()
 {
-    //*** get socket for new connection ***
-    QTcpSocket *clientSock = tcpServer_->nextPendingConnection();
+    FauxMoLogScope logScope( pool_->parent() );
 
-    //*** delete socket on disconnect ***
-    connect( clientSock, &QAbstractSocket::disconnected, clientSock, &QObject::deleteLater );
+    while ( tcpServer_->hasPendingConnections() )
+    {
+        //*** get socket for new connection ***
+        QTcpSocket *clientSock = tcpServer_->nextPendingConnection();
 
-    //*** read socket data ***
-    connect( clientSock, SIGNAL(readyRead()), SLOT(clientDataAvailable()) );
+        FAUXMO_TRACE( trace, TcpAccept, quintptr(clientSock) );
 
-    //*** monitor errors ***
-    connect( clientSock, SIGNAL(error(QAbstractSocket::SocketError)),
-                         SLOT(clientError(QAbstractSocket::SocketError)) );
+        //*** check connection limits - rejected sockets are aborted ***
+        guard_->admit( clientSock, this );
+    }
 }
 
 
 //*****************************************************************************
 //*****************************************************************************
 /**
- * @brief WemoDevice::clientError
- * @param socketError
+ * @brief WemoDevice::connectionError
+ * @param conn
  */
 //*****************************************************************************
-void WemoDevice::clientError( QAbstractSocket::SocketError socketError )
+void WemoDevice::connectionError( PooledConnection *conn )
 {
-    //*** don't worry about disconnects - they are expected ***
-    if ( socketError != QAbstractSocket::RemoteHostClosedError )
-    {
-        //*** get client socket for this signal ***
-        QTcpSocket *client = dynamic_cast<QTcpSocket*>(sender());
-
-        //*** expose error ***
-        QString errStr = "[" + deviceName_ + "] Client socket error: " + client->errorString();
-        emit error( errStr );
-    }
+    //*** expose error ***
+    FAUXMO_LOG( Connection, Warning, protocol_.name(), "Client socket error: %s",
+                qPrintable( conn->sock->errorString() ) );
 }
 
 
 //*****************************************************************************
 //*****************************************************************************
 /**
- * @brief WemoDevice::clientDataAvailable
+ * @brief WemoDevice::connectionReadyRead - parses in the connection's request
+ *        arena and assembles the response in its response arena
+ * @param conn
  */
 //*****************************************************************************
-void WemoDevice::clientDataAvailable()
+void WemoDevice::connectionReadyRead( PooledConnection *conn )
 {
-QString body;
-const QString SetupStr    = "GET /setup.xml HTTP/1.1";
-const QString EventStr    = "/eventservice.xml";
-const QString MetaInfoStr = "/metainfoservice.xml";
-const QString ActionStr   = "POST /upnp/control/basicevent1 HTTP/1.1";
+int size = 0;
 
-    //*** get client socket ***
-    QTcpSocket* sock = dynamic_cast<QTcpSocket*>( sender() );
+    QTcpSocket *sock = conn->sock;
 
-    if ( !sock ) return;
+    FAUXMO_TRACE( trace, TcpData, quintptr(sock) );
+    WatchdogScope watch( watchdog_, LoopWatchdog::DeviceRequest );
 
-    //*** save address and port of sender ***
-    peerAddr_ = sock->peerAddress();
+    //*** save address and port of sender - kept as a number, no copies ***
+    peerIp_   = sock->peerAddress().toIPv4Address();
     peerPort_ = sock->peerPort();
 
-    //*** make sure there's data ***
-    qint64 bytesAvailable = sock->bytesAvailable();
-    if ( bytesAvailable < 1 ) return;
+    //*** read until we have a full request (limits enforced by guard) ***
+    if ( guard_->readRequest( sock, conn->request, size ) != ConnectionGuard::Complete ) return;
 
-    //*** read in all the data ***
-    QByteArray allData = sock->readAll();
+    //*** one request per connection - anything pipelined behind it is dropped ***
+    conn->request.resize( size );
 
-    //*** make sure we got all that was expected ***
-    if ( bytesAvailable != allData.size() )
-    {
-        emit error( "[" + deviceName_ + "] Mismatch in client data read" );
-        return;
-    }
+    //*** traffic capture for replay ***
+    if ( FauxMoCapture::enabled() )
+        FauxMoCapture::record( FauxMoCapture::Http, peerIp_, peerPort_, port_, conn->request.constData(), size );
 
-    //*** convert to a QString ***
-    QString data = allData.data();
-
-    //*** determine how to handle this message ***
-    if ( data.contains( SetupStr ) )
-        body = handleSetup();
-    else if ( data.contains( EventStr ) )
-        body = handleEvent();
-    else if ( data.contains( MetaInfoStr ) )
-        body = handleMetaInfo();
-    else if ( data.contains( ActionStr ) )
-        body = handleAction( data );
-    else
+    //*** protocol core renders the response into the connection's arena ***
+    bool before = protocol_.state();
+    WemoProtocol::Result result;
     {
-        emit msgOut( "[" + deviceName_ + "] Unknown TCP message received");
-        return;
+        FAUXMO_TRACE( handlerTrace, Handler, quintptr(sock) );
+        result = protocol_.handleRequest( conn->request.constData(), size, conn->response );
     }
 
-    //*** if no body, then no response expected ***
-    if ( body.isEmpty() ) return;
-
-    //*** add the http header and create a full message ***
-    QByteArray msgOut = createMsg( body );
-
-    //*** send the message ***
-    sock->write( msgOut );
-}
-
-
-//*****************************************************************************
-//*****************************************************************************
-/**
- * @brief WemoDevice::handleSetup
- * @return - body of setup message
- */
-//*****************************************************************************
-QString WemoDevice::handleSetup()
-{
-QString body;
-
-    //*** create from template ***
-    body = QString( SETUP_XML ).arg( deviceName_ ).arg( uuid_ );
-
-    return body;
-}
-
-
-//*****************************************************************************
-//*****************************************************************************
-/**
- * @brief WemoDevice::handleEvent
- * @return - body of event message
- */
-//*****************************************************************************
-QString WemoDevice::handleEvent()
-{
-QString body;
+    if ( result == WemoProtocol::StateSet )
+    {
+        //*** display who is controlling us ***
+        FAUXMO_LOG( Device, Debug, protocol_.name(), "%u.%u.%u.%u:%u - SetBinaryState",
+                    peerIp_ >> 24, ( peerIp_ >> 16 ) & 0xff, ( peerIp_ >> 8 ) & 0xff, peerIp_ & 0xff,
+                    unsigned(peerPort_) );
 
-    //*** create from template ***
-    body = EVENT_SERVICE_XML;
+        if ( stateExport_ && protocol_.state() != before ) stateExport_->publish( exportSlot_, protocol_.state() );
 
-    return body;
-}
+        //*** let parent program handle new state ***
+        announceState( protocol_.state() );
+    }
 
+    //*** if no response, leave the connection to the guard's deadlines ***
+    if ( result == WemoProtocol::NoResponse )
+    {
+        pool_->requestDone( conn );
+        return;
+    }
 
-//*****************************************************************************
-//*****************************************************************************
-/**
- * @brief WemoDevice::handleMetaInfo
- * @return
- */
-//*****************************************************************************
-QString WemoDevice::handleMetaInfo()
-{
-QString body;
+    //*** send the message ***
+    {
+        FAUXMO_TRACE( writeTrace, TcpWrite, quintptr(sock) );
+        sock->write( conn->response );
+    }
 
-    //*** create from template ***
-    body = METAINFO_XML;
+    pool_->requestDone( conn );
 
-    return body;
+    //*** we advertise 'CONNECTION: close' - close once the response is flushed ***
+    sock->disconnectFromHost();
 }
 
 
 //*****************************************************************************
 //*****************************************************************************
 /**
- * @brief WemoDevice::handleAction
- * @param msgIn
- * @return
+ * @brief WemoDevice::setCurrentState - also publishes changes to the shared
+ *        memory state table
+ * @param state
  */
 //*****************************************************************************
-QString WemoDevice::handleAction( QString msgIn )
+void WemoDevice::setCurrentState( bool state )
 {
-QString body;
+    if ( state == protocol_.state() ) return;
 
-    //*** handle 'get state' action ***
-    if ( msgIn.contains( "GetBinaryState" ) )
-    {
-        //*** return current state as a 'soap' response ***
-        body = QString( SOAP_RESPONSE ).arg("Get").arg("BinaryState").arg(state_ ? "1" : "0");
-    }
+    protocol_.setState( state );
 
-    //*** handle 'set state' action ***
-    else if ( msgIn.contains( "SetBinaryState" ) )
-    {
-        //*** display who is controlling us ***
-        QString peer = peerAddr_.toString() + ":" + QString::number( peerPort_ );
-        emit msgOut( "[" + deviceName_ + "] " + peer + " - SetBinaryState" );
-
-        //*** off ***
-        if ( msgIn.contains( "<BinaryState>0</BinaryState>") )
-        {
-            //*** set our current state ***
-            state_ = false;
-
-            //*** let parent program handle new state ***
-            emit setDeviceState( deviceName_, false );
-        }
-
-        //*** on ***
-        else if ( msgIn.contains( "<BinaryState>1</BinaryState>") )
-        {
-            //*** set our current state ***
-            state_ = true;
-
-            //*** let parent program handle new state ***
-            emit setDeviceState( deviceName_, true );
-        }
-
-        //*** unknown ***
-        else
-        {
-            emit error( "[" + deviceName_ + "] Invalid SetBinaryState msg" );
-        }
-
-        //*** create response from template ***
-        body = QString( SOAP_RESPONSE ).arg("Set").arg("BinaryState").arg(state_ ? "1" : "0");
-    }
-
-    //*** handle 'get friendly name' action ***
-    else if ( msgIn.contains( "GetFriendlyName") )
-    {
-        //*** create from template ***
-        body = QString( SOAP_RESPONSE ).arg("Get").arg("FriendlyName").arg(deviceName_);
-    }
-
-    return body;
+    if ( stateExport_ ) stateExport_->publish( exportSlot_, state );
 }
 
 
 //*****************************************************************************
 //*****************************************************************************
 /**
- * @brief WemoDevice::createMsg
- * @param body
- * @return
+ * @brief WemoDevice::announceState - emits setDeviceState, timing the host
+ *        slots that run synchronously from it
+ * @param state
  */
 //*****************************************************************************
-QByteArray WemoDevice::createMsg( QString body )
+void WemoDevice::announceState( bool state )
 {
-    //*** convert body to utf8 ***
-    QByteArray bodyUtf8 = body.toUtf8();
-
-    //*** create header from template ***
-    QString hdr = QString( HTTP_HEADER ).arg( bodyUtf8.size() ).arg( timeStr() );
+    WatchdogScope watch( watchdog_, LoopWatchdog::AppHandler );
 
-    //*** combine header and body ***
-    return hdr.toUtf8() + body.toUtf8();
+    emit setDeviceState( protocol_.name(), state );
 }
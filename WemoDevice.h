@@ -8,40 +8,64 @@
 #include <QUuid>
 #include <QAbstractSocket>
 
+#include "ConnectionGuard.h"
+#include "ConnectionPool.h"
+#include "LoopWatchdog.h"
+#include "StateExport.h"
+#include "FauxMoProtocol.h"
+
 //*****************************************************************************
 //*****************************************************************************
 /**
  * @brief The WemoDevice class
  */
 //*****************************************************************************
-class WemoDevice : public QObject
+class WemoDevice : public QObject, public ConnectionHandler
 {
     Q_OBJECT
 
 public:
 
     //*** constructor ***
-    explicit WemoDevice( QString name, quint16 port, QObject *parent = nullptr);
+    explicit WemoDevice( QString name, quint16 port, ConnectionGuard *guard, ConnectionPool *pool,
+                         LoopWatchdog *watchdog, QObject *parent = nullptr);
 
     //*** destructor ***
     ~WemoDevice();
 
     //*** sets the current state of the device ***
-    void setCurrentState( bool state ) { state_ = state; }
+    void setCurrentState( bool state );
+
+    //*** publish state changes to a shared memory table entry, nullptr to stop ***
+    void setStateExport( StateExport *exp, int slot ) { stateExport_ = exp; exportSlot_ = slot; }
+    int exportSlot() { return exportSlot_; }
+
+    //*** return current state ***
+    bool getState() { return protocol_.state(); }
+
+    //*** starts serving the Wemo protocol on our port ***
+    bool listen();
+
+    //*** renames the device - friendly name served from now on ***
+    void setName( QString name ) { protocol_.setName( name ); }
+
+    //*** replaces the generated id - call before the device is advertised ***
+    void setUuid( QString uuid ) { protocol_.setUuid( uuid ); }
+
+    //*** stops accepting connections and frees the port, open ones are kept ***
+    void shutdown() { tcpServer_->close(); }
 
     //*** return device info ***
     quint16 getPort() { return port_; }
-    QString getName() { return deviceName_; }
-    QString getUuid() { return uuid_; }
+    QString getName() { return protocol_.name(); }
+    QString getUuid() { return protocol_.uuid(); }
 
+    //*** ConnectionHandler - called by the pool for our connections ***
+    void connectionReadyRead( PooledConnection *conn ) override;
+    void connectionError( PooledConnection *conn ) override;
 
-signals:
 
-    //*** error messages ***
-    void error( QString errStr );
-
-    //*** general messages ***
-    void msgOut( QString msgStr );
+signals:
 
     //*** announce device state set by Alexa ***
     void setDeviceState( QString devName, bool state );
@@ -52,46 +76,38 @@ private slots:
     //*** called when there is a new TCP connection ***
     void newTcpConnection();
 
-    //*** TCP socket error ***
-    void clientError( QAbstractSocket::SocketError socketError );
-
-    //*** TCP message received ***
-    void clientDataAvailable();
-
 
 private:
 
-    //*** returns current time/date in correct format ***
-    QString timeStr() { return QDateTime::currentDateTime().toString( Qt::RFC2822Date ); }
-
-    //*** handlers for different TCP messages ***
-    QString handleSetup();
-    QString handleEvent();
-    QString handleMetaInfo();
-    QString handleAction( QString msgIn );
+    //*** tells the host program about a new state ***
+    void announceState( bool state );
 
-    //*** adds http header to body to create full message ***
-    QByteArray createMsg( QString body );
 
-
-    //*** name of this device ***
-    QString deviceName_;
+    //*** name, id, state and the requests served for them ***
+    WemoProtocol protocol_;
 
     //*** unique port for this device ***
     quint16 port_;
 
-    //*** unique id for this device ***
-    QString uuid_;
-
-    //*** current state for this device ***
-    bool state_;
-
-    //*** holds address info for connected peer ***
-    QHostAddress peerAddr_;
-    quint16      peerPort_;
+    //*** holds address info for connected peer - IPv4, host byte order ***
+    quint32 peerIp_;
+    quint16 peerPort_;
 
     //*** TCP server for the device ***
     QTcpServer *tcpServer_;
+
+    //*** shared admission control / deadlines ***
+    ConnectionGuard *guard_;
+
+    //*** shared recycled connections ***
+    ConnectionPool *pool_;
+
+    //*** shared stall watchdog ***
+    LoopWatchdog *watchdog_;
+
+    //*** shared memory state table and our entry ***
+    StateExport *stateExport_;
+    int exportSlot_;
 };
 
 #endif // WEMODEVICE_H
@@ -0,0 +1,116 @@
+#include "AllocCounter.h"
+
+#include <cstdlib>
+#include <new>
+#include <atomic>
+
+//*** threads not ignored - the per thread ones are plain, so reading them
+//*** from malloc never allocates ***
+static std::atomic<quint64> allocs( 0 );
+static thread_local quint64 threadAllocs = 0;
+static thread_local bool ignored = false;
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief countAlloc
+ */
+//*****************************************************************************
+static inline void countAlloc()
+{
+    threadAllocs++;
+
+    if ( !ignored ) allocs.fetch_add( 1, std::memory_order_relaxed );
+}
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief allocCount
+ * @return
+ */
+//*****************************************************************************
+quint64 allocCount()
+{
+    return allocs.load( std::memory_order_relaxed );
+}
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief threadAllocCount
+ * @return
+ */
+//*****************************************************************************
+quint64 threadAllocCount()
+{
+    return threadAllocs;
+}
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief ignoreThreadAllocations
+ */
+//*****************************************************************************
+void ignoreThreadAllocations()
+{
+    ignored = true;
+}
+
+
+#if defined(__GLIBC__)
+
+//*** glibc's own entry points - ours replace the public names ***
+extern "C" void *__libc_malloc( size_t size );
+extern "C" void *__libc_calloc( size_t count, size_t size );
+extern "C" void *__libc_realloc( void *ptr, size_t size );
+
+extern "C" void *malloc( size_t size ) noexcept
+{
+    countAlloc();
+    return __libc_malloc( size );
+}
+
+extern "C" void *calloc( size_t count, size_t size ) noexcept
+{
+    countAlloc();
+    return __libc_calloc( count, size );
+}
+
+extern "C" void *realloc( void *ptr, size_t size ) noexcept
+{
+    countAlloc();
+    return __libc_realloc( ptr, size );
+}
+
+#else
+
+void *operator new( std::size_t size )
+{
+    countAlloc();
+
+    if ( void *p = std::malloc( size ? size : 1 ) ) return p;
+    throw std::bad_alloc();
+}
+
+void *operator new[]( std::size_t size )
+{
+    return operator new( size );
+}
+
+void operator delete( void *p ) noexcept
+{
+    std::free( p );
+}
+
+void operator delete[]( void *p ) noexcept
+{
+    std::free( p );
+}
+
+#endif
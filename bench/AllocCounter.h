@@ -0,0 +1,26 @@
+#ifndef ALLOCCOUNTER_H
+#define ALLOCCOUNTER_H
+
+#include <QtGlobal>
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * Heap allocation counter for the bench. On glibc malloc, calloc and realloc
+ * are interposed, which covers operator new and Qt's containers in every
+ * library of the process. Elsewhere only operator new is counted. Each
+ * thread counts its own, a thread that calls ignoreThreadAllocations (the
+ * load generator) is left out of allocCount.
+ */
+//*****************************************************************************
+
+//*** allocations so far on every thread not ignored ***
+quint64 allocCount();
+
+//*** allocations so far on the calling thread ***
+quint64 threadAllocCount();
+
+//*** leaves the calling thread out of allocCount from now on ***
+void ignoreThreadAllocations();
+
+#endif // ALLOCCOUNTER_H
@@ -0,0 +1,10 @@
+TARGET = fauxmo-bench
+
+include(../FauxMoApp.pri)
+
+SOURCES += \
+    AllocCounter.cpp \
+    main.cpp
+
+HEADERS += \
+    AllocCounter.h
@@ -0,0 +1,393 @@
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QEventLoop>
+#include <QThread>
+#include <QTextStream>
+#include <QStringList>
+#include <QElapsedTimer>
+
+#include <algorithm>
+
+#include "FauxMoQt.h"
+#include "FauxMoSoak.h"
+#include "FauxMoProtocol.h"
+#include "ConnectionPool.h"
+#include "AllocCounter.h"
+
+#if defined(Q_OS_UNIX)
+#include <sys/resource.h>
+#endif
+
+//*** defaults ***
+const int BENCH_DEVICES          = 16;
+const int BENCH_DURATION_SEC     = 10;
+const int BENCH_WARMUP_SEC       = 2;
+const int BENCH_REQUESTS_PER_SEC = 500;
+const int BENCH_SEARCHES_PER_SEC = 20;
+const int BENCH_ITERATIONS       = 100000;
+
+//*** datagrams for the in-process run ***
+const char BENCH_SEARCH[] =
+    "M-SEARCH * HTTP/1.1\r\n"
+    "HOST: 239.255.255.250:1900\r\n"
+    "MAN: \"ssdp:discover\"\r\n"
+    "MX: 1\r\n"
+    "ST: upnp:rootdevice\r\n"
+    "\r\n";
+
+const char BENCH_NOTIFY[] =
+    "NOTIFY * HTTP/1.1\r\n"
+    "HOST: 239.255.255.250:1900\r\n"
+    "NT: upnp:rootdevice\r\n"
+    "NTS: ssdp:alive\r\n"
+    "\r\n";
+
+//*** device requests for the in-process run, %1 = action, %2 = arguments ***
+const char BENCH_SETUP_REQUEST[] =
+    "GET /setup.xml HTTP/1.1\r\n"
+    "Host: 127.0.0.1:19125\r\n"
+    "\r\n";
+
+const char BENCH_ACTION_REQUEST[] =
+    "POST /upnp/control/basicevent1 HTTP/1.1\r\n"
+    "Host: 127.0.0.1:19125\r\n"
+    "Content-Type: text/xml; charset=\"utf-8\"\r\n"
+    "SOAPACTION: \"urn:Belkin:service:basicevent:1#%1\"\r\n"
+    "\r\n"
+    "<?xml version=\"1.0\" encoding=\"utf-8\"?>"
+    "<s:Envelope xmlns:s=\"http://schemas.xmlsoap.org/soap/envelope/\"><s:Body>"
+    "<u:%1 xmlns:u=\"urn:Belkin:service:basicevent:1\">%2</u:%1>"
+    "</s:Body></s:Envelope>";
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief The BenchResult struct - one engine's run
+ */
+//*****************************************************************************
+struct BenchResult
+{
+    QString engine;
+    quint64 requests = 0;
+    quint64 errors   = 0;
+    quint64 dropped  = 0;
+    qint64  p50Us    = 0;       // over every request of the run
+    qint64  p99Us    = 0;
+    double  cpuSec   = 0;       // process CPU less the load generator's thread
+
+    //*** heap allocations after warm-up on every thread but the load
+    //*** generator's, and the requests served in that time ***
+    quint64 allocs         = 0;
+    quint64 steadyRequests = 0;
+};
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief cpuSeconds - user + system time of this process or thread
+ * @param thisThread - the calling thread only (Linux)
+ * @return - 0 if not available on this platform
+ */
+//*****************************************************************************
+static double cpuSeconds( bool thisThread = false )
+{
+#if defined(Q_OS_UNIX)
+struct rusage ru;
+
+#if defined(Q_OS_LINUX)
+    int who = thisThread ? RUSAGE_THREAD : RUSAGE_SELF;
+#else
+    if ( thisThread ) return 0;
+    int who = RUSAGE_SELF;
+#endif
+
+    if ( getrusage( who, &ru ) != 0 ) return 0;
+
+    return double( ru.ru_utime.tv_sec + ru.ru_stime.tv_sec ) +
+           double( ru.ru_utime.tv_usec + ru.ru_stime.tv_usec ) / 1e6;
+#else
+    Q_UNUSED( thisThread );
+    return 0;
+#endif
+}
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief runEngine - serves 'devices' devices on loopback with one engine and
+ *        drives the soak load at it from a thread of its own, so neither
+ *        engine shares a thread with the load generator
+ * @param engine
+ * @param loops - epoll loops, <= 0 for one per core
+ * @param devices
+ * @param config - samples up to warmupSec are left out of the allocation count
+ * @return
+ */
+//*****************************************************************************
+static BenchResult runEngine( FauxMoQt::Engine engine, int loops, int devices, const SoakConfig &config )
+{
+BenchResult res;
+QList<SoakSample> samples;
+QVector<qint64> latencies;
+double loadCpu = 0;
+quint64 allocStart = 0;
+quint64 allocEnd   = 0;
+
+    FauxMoQt fauxMo( engine, loops );
+    fauxMo.setInterfaces( QStringList() << "lo" );
+
+    for ( int i = 0; i < devices; i++ )
+        fauxMo.addDevice( QString( "bench-%1" ).arg( i ) );
+
+    fauxMo.initialize();
+    fauxMo.enableDiscovery( true );
+
+    //*** may have fallen back ***
+    res.engine = fauxMo.engine() == FauxMoQt::EpollEventLoop ? "epoll" : "qt";
+
+    //*** the load generator is created, run and deleted on its own thread -
+    //*** these lambdas have no context object so they run there ***
+    QThread loadThread;
+    QEventLoop loop;
+
+    QObject::connect( &loadThread, &QThread::started, [&]()
+    {
+        double cpuStart = cpuSeconds( true );
+
+        //*** its own sockets, timers and strings are not the engine's ***
+        ignoreThreadAllocations();
+        allocStart = allocCount();
+
+        FauxMoSoak *soak = new FauxMoSoak;
+        soak->setConfig( config );
+
+        //*** pools and arenas fill during warm-up - count from its last sample ***
+        QObject::connect( soak, &FauxMoSoak::sampled, [&]( SoakSample s )
+        {
+            if ( s.elapsedMs <= qint64(config.warmupSec) * 1000 ) allocStart = allocCount();
+        } );
+
+        QObject::connect( soak, &FauxMoSoak::finished, [&, soak, cpuStart]()
+        {
+            allocEnd  = allocCount();
+            loadCpu   = cpuSeconds( true ) - cpuStart;
+            samples   = soak->samples();
+            latencies = soak->latencies();
+
+            soak->deleteLater();
+            loadThread.quit();
+        } );
+
+        soak->start();
+    } );
+
+    QObject::connect( &loadThread, SIGNAL(finished()), &loop, SLOT(quit()) );
+
+    double cpuStart = cpuSeconds();
+
+    loadThread.start();
+    loop.exec();
+    loadThread.wait();
+
+    res.cpuSec = cpuSeconds() - cpuStart - loadCpu;
+    res.allocs = allocEnd - allocStart;
+
+    foreach( auto s, samples )
+    {
+        res.requests += s.requests;
+        res.errors   += s.errors;
+        res.dropped  += s.dropped;
+
+        if ( s.elapsedMs > qint64(config.warmupSec) * 1000 ) res.steadyRequests += s.requests;
+    }
+
+    std::sort( latencies.begin(), latencies.end() );
+    res.p50Us = FauxMoSoak::percentileUs( latencies, 50 );
+    res.p99Us = FauxMoSoak::percentileUs( latencies, 99 );
+
+    return res;
+}
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief runProtocol - the request path without sockets: each request is
+ *        handled 'iterations' times into a response arena reused the way the
+ *        connection pool does, after one warm-up call that renders the
+ *        cached bodies. Then search classification the same way.
+ * @param iterations
+ * @param out
+ */
+//*****************************************************************************
+static void runProtocol( int iterations, QTextStream &out )
+{
+    WemoProtocol protocol( "bench", "Socket-1_0-bench" );
+
+    QByteArray response;
+    response.reserve( POOL_RESPONSE_ARENA );
+
+    QList< QPair<QString,QByteArray> > cases;
+    cases << qMakePair( QString( "setup.xml" ), QByteArray( BENCH_SETUP_REQUEST ) );
+    cases << qMakePair( QString( "GetBinaryState" ),
+                        QString( BENCH_ACTION_REQUEST ).arg( "GetBinaryState" ).arg( "" ).toUtf8() );
+    cases << qMakePair( QString( "SetBinaryState" ),
+                        QString( BENCH_ACTION_REQUEST ).arg( "SetBinaryState" ).arg( "<BinaryState>1</BinaryState>" ).toUtf8() );
+    cases << qMakePair( QString( "GetFriendlyName" ),
+                        QString( BENCH_ACTION_REQUEST ).arg( "GetFriendlyName" ).arg( "" ).toUtf8() );
+
+    out << "request            ns/op  allocs/op" << "\n";
+
+    foreach( auto c, cases )
+    {
+        const QByteArray &request = c.second;
+
+        protocol.handleRequest( request.constData(), request.size(), response );
+        response.resize( 0 );
+
+        QElapsedTimer timer;
+        quint64 allocStart = threadAllocCount();
+        timer.start();
+
+        for ( int i = 0; i < iterations; i++ )
+        {
+            protocol.handleRequest( request.constData(), request.size(), response );
+            response.resize( 0 );
+        }
+
+        qint64 ns = timer.nsecsElapsed();
+        quint64 allocs = threadAllocCount() - allocStart;
+
+        out << QString( "%1 %2 %3" )
+               .arg( c.first, -16 )
+               .arg( ns / iterations, 8 )
+               .arg( double( allocs ) / iterations, 10, 'f', 3 ) << "\n";
+    }
+
+    //*** discovery - a match past the first target, and a datagram we ignore ***
+    cases.clear();
+    cases << qMakePair( QString( "M-SEARCH" ), QByteArray( BENCH_SEARCH ) );
+    cases << qMakePair( QString( "NOTIFY" ), QByteArray( BENCH_NOTIFY ) );
+
+    foreach( auto c, cases )
+    {
+        const QByteArray &datagram = c.second;
+        int matched = 0;
+
+        QElapsedTimer timer;
+        quint64 allocStart = threadAllocCount();
+        timer.start();
+
+        for ( int i = 0; i < iterations; i++ )
+        {
+            if ( FauxMoProtocol::classifySearch( datagram.constData(), datagram.size() ) != SsdpNone )
+                matched++;
+        }
+
+        qint64 ns = timer.nsecsElapsed();
+        quint64 allocs = threadAllocCount() - allocStart;
+
+        //*** keeps the loop from being optimized out ***
+        if ( matched != 0 && matched != iterations ) out << "classifySearch is not deterministic" << "\n";
+
+        out << QString( "%1 %2 %3" )
+               .arg( c.first, -16 )
+               .arg( ns / iterations, 8 )
+               .arg( double( allocs ) / iterations, 10, 'f', 3 ) << "\n";
+    }
+}
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief main - runs the Qt engine and then the epoll engine under the same
+ *        load and prints one line per engine, or with --protocol times the
+ *        request path in-process
+ */
+//*****************************************************************************
+int main( int argc, char *argv[] )
+{
+    QCoreApplication app( argc, argv );
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription( "Compares the Qt and epoll engines under the same load on loopback" );
+    parser.addHelpOption();
+
+    QCommandLineOption devicesOpt( "devices", "Devices served.", "n", QString::number( BENCH_DEVICES ) );
+    QCommandLineOption durationOpt( "duration", "Seconds per engine.", "sec", QString::number( BENCH_DURATION_SEC ) );
+    QCommandLineOption warmupOpt( "warmup", "Seconds left out of allocs/req.", "sec", QString::number( BENCH_WARMUP_SEC ) );
+    QCommandLineOption rateOpt( "rate", "Device requests per second.", "n", QString::number( BENCH_REQUESTS_PER_SEC ) );
+    QCommandLineOption loopsOpt( "loops", "epoll loops, 0 for one per core.", "n", "0" );
+    QCommandLineOption engineOpt( "engine", "qt, epoll or both.", "name", "both" );
+    QCommandLineOption protocolOpt( "protocol", "Time the request path in-process instead, no sockets." );
+    QCommandLineOption iterationsOpt( "iterations", "Calls per request with --protocol.", "n",
+                                      QString::number( BENCH_ITERATIONS ) );
+
+    parser.addOption( devicesOpt );
+    parser.addOption( durationOpt );
+    parser.addOption( warmupOpt );
+    parser.addOption( rateOpt );
+    parser.addOption( loopsOpt );
+    parser.addOption( engineOpt );
+    parser.addOption( protocolOpt );
+    parser.addOption( iterationsOpt );
+    parser.process( app );
+
+    QTextStream out( stdout );
+
+    if ( parser.isSet( protocolOpt ) )
+    {
+        runProtocol( qMax( 1, parser.value( iterationsOpt ).toInt() ), out );
+        return 0;
+    }
+
+    SoakConfig config;
+    config.durationSec       = qMax( 1, parser.value( durationOpt ).toInt() );
+    config.sampleIntervalSec = 1;
+    config.warmupSec         = qMax( 0, parser.value( warmupOpt ).toInt() );
+    config.searchesPerSec    = BENCH_SEARCHES_PER_SEC;
+    config.requestsPerSec    = qMax( 1, parser.value( rateOpt ).toInt() );
+    config.keepLatencies     = true;
+
+    int devices = qMax( 1, parser.value( devicesOpt ).toInt() );
+    int loops   = parser.value( loopsOpt ).toInt();
+
+    QString which = parser.value( engineOpt );
+
+    QList<FauxMoQt::Engine> engines;
+    if ( which == "qt" || which == "both" ) engines << FauxMoQt::QtEventLoop;
+    if ( which == "epoll" || which == "both" ) engines << FauxMoQt::EpollEventLoop;
+
+    if ( engines.isEmpty() )
+    {
+        QTextStream( stderr ) << "Unknown engine " << which << "\n";
+        return 2;
+    }
+
+    out << QString( "%1 devices, %2 requests/s, %3 s per engine" )
+           .arg( devices ).arg( config.requestsPerSec ).arg( config.durationSec ) << "\n";
+    out << "engine   requests   errors  dropped   p50 us   p99 us   cpu s  allocs/req" << "\n";
+
+    foreach( auto engine, engines )
+    {
+        out.flush();
+
+        BenchResult res = runEngine( engine, loops, devices, config );
+
+        out << QString( "%1 %2 %3 %4 %5 %6 %7 %8" )
+               .arg( res.engine, -6 )
+               .arg( res.requests, 10 )
+               .arg( res.errors, 8 )
+               .arg( res.dropped, 8 )
+               .arg( res.p50Us, 8 )
+               .arg( res.p99Us, 8 )
+               .arg( res.cpuSec, 7, 'f', 2 )
+               .arg( res.steadyRequests ? double( res.allocs ) / res.steadyRequests : 0.0, 11, 'f', 1 ) << "\n";
+    }
+
+    return 0;
+}
@@ -0,0 +1,12 @@
+# libFuzzer target for the protocol core - needs clang:
+#   qmake -spec linux-clang CONFIG+=fauxmo_fuzz FauxMo.pro && make
+#   fuzz/fauxmo-fuzz corpus/
+TARGET = fauxmo-fuzz
+
+include(../FauxMoApp.pri)
+
+QMAKE_CXXFLAGS += -fsanitize=fuzzer,address
+QMAKE_LFLAGS += -fsanitize=fuzzer,address
+
+SOURCES += \
+    main.cpp
@@ -0,0 +1,49 @@
+#include <QByteArray>
+
+#include "FauxMoProtocol.h"
+
+#include <stdint.h>
+#include <stddef.h>
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief fuzz - one input through everything the adapters feed untrusted
+ *        bytes to: search classification, the header scans and a device
+ *        request
+ * @param data
+ * @param len
+ */
+//*****************************************************************************
+static void fuzz( const char *data, int len )
+{
+    //*** same device every run - state carries over like a real one ***
+    static WemoProtocol protocol( "fuzz", "Socket-1_0-fuzz" );
+
+    FauxMoProtocol::classifySearch( data, len );
+    FauxMoProtocol::contentLength( data, len );
+
+    QByteArray out;
+    protocol.handleRequest( data, len, out );
+}
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief LLVMFuzzerTestOneInput - libFuzzer entry
+ * @param data
+ * @param size
+ * @return
+ */
+//*****************************************************************************
+extern "C" int LLVMFuzzerTestOneInput( const uint8_t *data, size_t size )
+{
+    //*** datagrams and requests are capped well below this ***
+    if ( size > 65536 ) return 0;
+
+    fuzz( reinterpret_cast<const char*>( data ), int( size ) );
+
+    return 0;
+}
@@ -0,0 +1,104 @@
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QStringList>
+#include <QScopedPointer>
+
+#include <cstdio>
+
+#include "FauxMoQt.h"
+#include "FauxMoReplay.h"
+#include "FauxMoLog.h"
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief main - plays a capture file back and prints what came back. Exits 0
+ *        if every device request got a good response, 1 otherwise, 2 on bad
+ *        arguments or an unreadable file.
+ */
+//*****************************************************************************
+int main( int argc, char *argv[] )
+{
+    QCoreApplication app( argc, argv );
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription( "Plays a FauxMo traffic capture back against an instance" );
+    parser.addHelpOption();
+    parser.addPositionalArgument( "capture", "Capture file written by FauxMoQt::startCapture." );
+
+    QCommandLineOption targetOpt( "target", "Instance to replay against.", "address", "127.0.0.1" );
+    QCommandLineOption speedOpt( "speed", "1 = capture speed, N = N times faster, 0 = as fast as possible.", "x", "1" );
+    QCommandLineOption inFlightOpt( "max-in-flight", "Device connections open at once.", "n",
+                                    QString::number( REPLAY_MAX_IN_FLIGHT ) );
+    QCommandLineOption serveOpt( "serve", "Start an instance on loopback with this config file and replay against "
+                                 "it. Give each device the port it had in the capture, automatic ones "
+                                 "(19125 and up) included.", "config" );
+
+    parser.addOptions( QList<QCommandLineOption>() << targetOpt << speedOpt << inFlightOpt << serveOpt );
+    parser.process( app );
+
+    if ( parser.positionalArguments().size() != 1 ) parser.showHelp( 2 );
+
+    QHostAddress target( parser.value( targetOpt ) );
+    if ( target.isNull() )
+    {
+        fprintf( stderr, "Bad target address %s\n", qPrintable( parser.value( targetOpt ) ) );
+        return 2;
+    }
+
+    //*** warnings and errors from the library ***
+    FauxMoLog::addSink( &app, []( const LogRecord &rec )
+    {
+        if ( rec.level >= FauxMoLog::Warning )
+            fprintf( stderr, "%s %s: %s\n", FauxMoLog::levelName( FauxMoLog::Level( rec.level ) ), rec.subject, rec.text );
+    } );
+
+    FauxMoReplay replay;
+    if ( !replay.load( parser.positionalArguments().first() ) ) return 2;
+
+    replay.setTarget( target );
+    replay.setSpeed( qMax( 0.0, parser.value( speedOpt ).toDouble() ) );
+    replay.setMaxInFlight( parser.value( inFlightOpt ).toInt() );
+
+    //*** in-process instance ***
+    QScopedPointer<FauxMoQt> fauxMo;
+    if ( parser.isSet( serveOpt ) )
+    {
+        fauxMo.reset( new FauxMoQt );
+        fauxMo->setInterfaces( QStringList() << "lo" );
+
+        if ( !fauxMo->loadConfig( parser.value( serveOpt ), false ) ) return 2;
+
+        fauxMo->initialize();
+        fauxMo->enableDiscovery( true );
+
+        replay.setTarget( QHostAddress::LocalHost );
+    }
+
+    QObject::connect( &replay, SIGNAL(finished()), &app, SLOT(quit()) );
+
+    printf( "Replaying %d records\n", replay.recordCount() );
+    fflush( stdout );
+
+    replay.start();
+    app.exec();
+
+    FauxMoLog::removeSinks( &app );
+
+    ReplayStats stats = replay.stats();
+
+    printf( "searches sent     %llu\n", stats.datagrams );
+    printf( "search responses  %llu\n", stats.ssdpResponses );
+    printf( "requests sent     %llu\n", stats.requests );
+    printf( "responses ok      %llu\n", stats.responsesOk );
+    printf( "responses bad     %llu\n", stats.responsesBad );
+    printf( "no response       %llu\n", stats.noResponse );
+    printf( "connect errors    %llu\n", stats.connectErrors );
+    printf( "late records      %llu\n", stats.lateRecords );
+    printf( "elapsed ms        %lld\n", stats.elapsedMs );
+    printf( "latency us        p50 %lld  p99 %lld  max %lld\n",
+            stats.latency.percentileUs( 50 ), stats.latency.percentileUs( 99 ), stats.latency.maxUs );
+
+    return stats.responsesOk == stats.requests ? 0 : 1;
+}
@@ -0,0 +1,6 @@
+TARGET = fauxmo-replay
+
+include(../FauxMoApp.pri)
+
+SOURCES += \
+    main.cpp
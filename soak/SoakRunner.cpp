@@ -0,0 +1,64 @@
+#include "SoakRunner.h"
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief SoakRunner::SoakRunner
+ * @param soak
+ * @param parent
+ */
+//*****************************************************************************
+SoakRunner::SoakRunner( FauxMoSoak *soak, QObject *parent )
+    : QObject(parent),
+      out_(stdout),
+      passed_(false)
+{
+    connect( soak, SIGNAL(sampled(SoakSample)), SLOT(sampled(SoakSample)) );
+    connect( soak, SIGNAL(finished(bool,QString)), SLOT(finished(bool,QString)) );
+
+    out_ << "elapsed s   rss kB  fds  devices  requests  errors  dropped   p50 us   p99 us" << "\n";
+    out_.flush();
+}
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief SoakRunner::sampled - one line per sample
+ * @param sample
+ */
+//*****************************************************************************
+void SoakRunner::sampled( SoakSample sample )
+{
+    out_ << QString( "%1 %2 %3 %4 %5 %6 %7 %8 %9" )
+            .arg( sample.elapsedMs / 1000, 9 )
+            .arg( sample.rssKb, 8 )
+            .arg( sample.openFds, 4 )
+            .arg( sample.devices, 8 )
+            .arg( sample.requests, 9 )
+            .arg( sample.errors, 7 )
+            .arg( sample.dropped, 8 )
+            .arg( sample.p50Us, 8 )
+            .arg( sample.p99Us, 8 ) << "\n";
+    out_.flush();
+}
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief SoakRunner::finished
+ * @param passed
+ * @param report
+ */
+//*****************************************************************************
+void SoakRunner::finished( bool passed, QString report )
+{
+    passed_ = passed;
+
+    out_ << ( passed ? "PASSED" : "FAILED" ) << "\n" << report << "\n";
+    out_.flush();
+
+    emit done();
+}
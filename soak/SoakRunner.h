@@ -0,0 +1,48 @@
+#ifndef SOAKRUNNER_H
+#define SOAKRUNNER_H
+
+#include <QObject>
+#include <QTextStream>
+
+#include "FauxMoSoak.h"
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief The SoakRunner class - prints samples as they come and keeps the
+ *        verdict for the exit code
+ */
+//*****************************************************************************
+class SoakRunner : public QObject
+{
+    Q_OBJECT
+
+public:
+
+    //*** constructor ***
+    explicit SoakRunner( FauxMoSoak *soak, QObject *parent = nullptr );
+
+    bool passed() const { return passed_; }
+
+
+signals:
+
+    //*** run over ***
+    void done();
+
+
+private slots:
+
+    void sampled( SoakSample sample );
+
+    void finished( bool passed, QString report );
+
+
+private:
+
+    QTextStream out_;
+
+    bool passed_;
+};
+
+#endif // SOAKRUNNER_H
@@ -0,0 +1,97 @@
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QStringList>
+
+#include <cstdio>
+
+#include "FauxMoQt.h"
+#include "FauxMoSoak.h"
+#include "FauxMoLog.h"
+#include "SoakRunner.h"
+
+//*** devices served by the instance under test ***
+const int SOAK_DEVICES = 16;
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief main - serves N devices on loopback, runs FauxMoSoak against them
+ *        and exits 0 if the run passed, 1 if it failed
+ */
+//*****************************************************************************
+int main( int argc, char *argv[] )
+{
+SoakConfig config;
+
+    QCoreApplication app( argc, argv );
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription( "Long running leak/drift check against an instance on loopback" );
+    parser.addHelpOption();
+
+    QCommandLineOption devicesOpt( "devices", "Devices served.", "n", QString::number( SOAK_DEVICES ) );
+    QCommandLineOption engineOpt( "engine", "qt or epoll.", "name", "qt" );
+    QCommandLineOption loopsOpt( "loops", "epoll loops, 0 for one per core.", "n", "0" );
+    QCommandLineOption durationOpt( "duration", "Run time in seconds.", "sec", QString::number( config.durationSec ) );
+    QCommandLineOption intervalOpt( "interval", "Seconds between samples.", "sec", QString::number( config.sampleIntervalSec ) );
+    QCommandLineOption warmupOpt( "warmup", "Seconds left out of the trend.", "sec", QString::number( config.warmupSec ) );
+    QCommandLineOption searchesOpt( "searches", "Searches per second.", "n", QString::number( config.searchesPerSec ) );
+    QCommandLineOption rateOpt( "rate", "Device requests per second.", "n", QString::number( config.requestsPerSec ) );
+    QCommandLineOption inFlightOpt( "max-in-flight", "Device connections open at once.", "n", QString::number( config.maxInFlight ) );
+    QCommandLineOption growthOpt( "max-growth", "Allowed rise of the last quarter over the first, percent.", "pct",
+                                  QString::number( config.maxGrowthPct ) );
+
+    parser.addOptions( QList<QCommandLineOption>() << devicesOpt << engineOpt << loopsOpt << durationOpt
+                       << intervalOpt << warmupOpt << searchesOpt << rateOpt << inFlightOpt << growthOpt );
+    parser.process( app );
+
+    config.durationSec       = qMax( 1, parser.value( durationOpt ).toInt() );
+    config.sampleIntervalSec = qMax( 1, parser.value( intervalOpt ).toInt() );
+    config.warmupSec         = qMax( 0, parser.value( warmupOpt ).toInt() );
+    config.searchesPerSec    = qMax( 0, parser.value( searchesOpt ).toInt() );
+    config.requestsPerSec    = qMax( 0, parser.value( rateOpt ).toInt() );
+    config.maxInFlight       = qMax( 1, parser.value( inFlightOpt ).toInt() );
+    config.maxGrowthPct      = parser.value( growthOpt ).toDouble();
+
+    FauxMoQt::Engine engine = FauxMoQt::QtEventLoop;
+    if ( parser.value( engineOpt ) == "epoll" )
+        engine = FauxMoQt::EpollEventLoop;
+    else if ( parser.value( engineOpt ) != "qt" )
+    {
+        fprintf( stderr, "Unknown engine %s\n", qPrintable( parser.value( engineOpt ) ) );
+        return 2;
+    }
+
+    //*** warnings and errors from the library ***
+    FauxMoLog::addSink( &app, []( const LogRecord &rec )
+    {
+        if ( rec.level >= FauxMoLog::Warning )
+            fprintf( stderr, "%s %s: %s\n", FauxMoLog::levelName( FauxMoLog::Level( rec.level ) ), rec.subject, rec.text );
+    } );
+
+    //*** instance under test ***
+    FauxMoQt fauxMo( engine, parser.value( loopsOpt ).toInt() );
+    fauxMo.setInterfaces( QStringList() << "lo" );
+
+    int devices = qMax( 1, parser.value( devicesOpt ).toInt() );
+    for ( int i = 0; i < devices; i++ )
+        fauxMo.addDevice( QString( "soak-%1" ).arg( i ) );
+
+    fauxMo.initialize();
+    fauxMo.enableDiscovery( true );
+
+    //*** load ***
+    FauxMoSoak soak;
+    soak.setConfig( config );
+
+    SoakRunner runner( &soak );
+    QObject::connect( &runner, SIGNAL(done()), &app, SLOT(quit()) );
+
+    soak.start();
+    app.exec();
+
+    FauxMoLog::removeSinks( &app );
+
+    return runner.passed() ? 0 : 1;
+}
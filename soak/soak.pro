@@ -0,0 +1,10 @@
+TARGET = fauxmo-soak
+
+include(../FauxMoApp.pri)
+
+SOURCES += \
+    SoakRunner.cpp \
+    main.cpp
+
+HEADERS += \
+    SoakRunner.h
@@ -0,0 +1,9 @@
+TARGET = tst_capture
+
+QT += testlib
+CONFIG += testcase
+
+include(../../FauxMoApp.pri)
+
+SOURCES += \
+    tst_capture.cpp
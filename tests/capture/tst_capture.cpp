@@ -0,0 +1,279 @@
+#include <QtTest>
+#include <QTemporaryDir>
+#include <QUdpSocket>
+#include <QTcpServer>
+#include <QTcpSocket>
+
+#include "FauxMoQt.h"
+#include "FauxMoCapture.h"
+#include "FauxMoReplay.h"
+
+const char SEARCH[] =
+    "M-SEARCH * HTTP/1.1\r\n"
+    "HOST: 239.255.255.250:1900\r\n"
+    "MAN: \"ssdp:discover\"\r\n"
+    "MX: 1\r\n"
+    "ST: urn:Belkin:device:controllee:1\r\n"
+    "\r\n";
+
+const char REQUEST[] =
+    "GET /setup.xml HTTP/1.1\r\n"
+    "Host: 127.0.0.1\r\n"
+    "\r\n";
+
+const char RESPONSE[] =
+    "HTTP/1.1 200 OK\r\n"
+    "CONTENT-LENGTH: 2\r\n"
+    "CONNECTION: close\r\n"
+    "\r\n"
+    "ok";
+
+//*** switches a device on ***
+const char SET_REQUEST[] =
+    "POST /upnp/control/basicevent1 HTTP/1.1\r\n"
+    "Content-Type: text/xml; charset=\"utf-8\"\r\n"
+    "SOAPACTION: \"urn:Belkin:service:basicevent:1#SetBinaryState\"\r\n"
+    "Content-Length: %1\r\n"
+    "\r\n"
+    "%2";
+
+const char SET_BODY[] =
+    "<?xml version=\"1.0\" encoding=\"utf-8\"?>"
+    "<s:Envelope xmlns:s=\"http://schemas.xmlsoap.org/soap/envelope/\"><s:Body>"
+    "<u:SetBinaryState xmlns:u=\"urn:Belkin:service:basicevent:1\"><BinaryState>1</BinaryState></u:SetBinaryState>"
+    "</s:Body></s:Envelope>";
+
+//*** 192.168.1.20 ***
+const quint32 PEER_IP = 0xc0a80114u;
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief The TestCapture class - capture files written by FauxMoCapture and
+ *        read back by FauxMoReplay, then played against local sockets and
+ *        against an instance
+ */
+//*****************************************************************************
+class TestCapture : public QObject
+{
+    Q_OBJECT
+
+private slots:
+
+    void init();
+    void cleanup();
+
+    void fileFormat();
+    void load();
+    void loadTruncated();
+    void loadRejects();
+    void replay();
+    void replayAgainstInstance();
+
+private:
+
+    //*** one search to udpPort, one request to tcpPort ***
+    void capture( quint16 udpPort, quint16 tcpPort );
+
+    QTemporaryDir dir_;
+    QString file_;
+};
+
+
+void TestCapture::init()
+{
+    QVERIFY( dir_.isValid() );
+    file_ = dir_.filePath( "traffic.fxcp" );
+}
+
+void TestCapture::cleanup()
+{
+    FauxMoCapture::stop();
+}
+
+void TestCapture::capture( quint16 udpPort, quint16 tcpPort )
+{
+    QVERIFY( FauxMoCapture::start( file_ ) );
+    QVERIFY( FauxMoCapture::enabled() );
+
+    FauxMoCapture::record( FauxMoCapture::Ssdp, PEER_IP, 50000, udpPort, SEARCH, int(strlen( SEARCH )) );
+    FauxMoCapture::record( FauxMoCapture::Http, PEER_IP, 50001, tcpPort, REQUEST, int(strlen( REQUEST )) );
+
+    //*** empty records are not written ***
+    FauxMoCapture::record( FauxMoCapture::Http, PEER_IP, 50002, tcpPort, REQUEST, 0 );
+
+    FauxMoCapture::stop();
+    QVERIFY( !FauxMoCapture::enabled() );
+}
+
+void TestCapture::fileFormat()
+{
+FauxMoCaptureHeader hdr;
+FauxMoCaptureRecord rec;
+
+    capture( 1900, 19125 );
+
+    QFile f( file_ );
+    QVERIFY( f.open( QIODevice::ReadOnly ) );
+
+    QCOMPARE( f.read( reinterpret_cast<char*>(&hdr), sizeof(hdr) ), qint64(sizeof(hdr)) );
+    QCOMPARE( hdr.magic, FAUXMO_CAPTURE_MAGIC );
+    QCOMPARE( hdr.version, FAUXMO_CAPTURE_VERSION );
+
+    QCOMPARE( f.read( reinterpret_cast<char*>(&rec), sizeof(rec) ), qint64(sizeof(rec)) );
+    QCOMPARE( rec.kind, quint8(FauxMoCapture::Ssdp) );
+    QCOMPARE( rec.peerIp, PEER_IP );
+    QCOMPARE( rec.peerPort, quint16(50000) );
+    QCOMPARE( rec.localPort, quint16(1900) );
+    QCOMPARE( f.read( rec.length ), QByteArray( SEARCH ) );
+
+    quint64 firstUs = rec.timeUs;
+
+    QCOMPARE( f.read( reinterpret_cast<char*>(&rec), sizeof(rec) ), qint64(sizeof(rec)) );
+    QCOMPARE( rec.kind, quint8(FauxMoCapture::Http) );
+    QCOMPARE( rec.peerPort, quint16(50001) );
+    QCOMPARE( rec.localPort, quint16(19125) );
+    QVERIFY( rec.timeUs >= firstUs );
+    QCOMPARE( f.read( rec.length ), QByteArray( REQUEST ) );
+
+    QVERIFY( f.atEnd() );
+}
+
+void TestCapture::load()
+{
+    capture( 1900, 19125 );
+
+    FauxMoReplay replay;
+    QVERIFY( replay.load( file_ ) );
+    QCOMPARE( replay.recordCount(), 2 );
+}
+
+void TestCapture::loadTruncated()
+{
+    capture( 1900, 19125 );
+
+    //*** cut into the last record's data - the complete ones are kept ***
+    QFile f( file_ );
+    QVERIFY( f.resize( f.size() - 5 ) );
+
+    FauxMoReplay replay;
+    QVERIFY( replay.load( file_ ) );
+    QCOMPARE( replay.recordCount(), 1 );
+}
+
+void TestCapture::loadRejects()
+{
+    FauxMoReplay replay;
+
+    QVERIFY( !replay.load( dir_.filePath( "missing.fxcp" ) ) );
+
+    QFile f( file_ );
+    QVERIFY( f.open( QIODevice::WriteOnly | QIODevice::Truncate ) );
+    f.write( "not a capture file at all" );
+    f.close();
+    QVERIFY( !replay.load( file_ ) );
+
+    //*** right magic, unknown version ***
+    FauxMoCaptureHeader hdr;
+    memset( &hdr, 0, sizeof(hdr) );
+    hdr.magic   = FAUXMO_CAPTURE_MAGIC;
+    hdr.version = FAUXMO_CAPTURE_VERSION + 1;
+
+    QVERIFY( f.open( QIODevice::WriteOnly | QIODevice::Truncate ) );
+    f.write( reinterpret_cast<const char*>(&hdr), sizeof(hdr) );
+    f.close();
+    QVERIFY( !replay.load( file_ ) );
+}
+
+void TestCapture::replay()
+{
+    //*** stand-ins for the instance ***
+    QUdpSocket udp;
+    QVERIFY( udp.bind( QHostAddress::LocalHost, 0 ) );
+
+    QTcpServer server;
+    QVERIFY( server.listen( QHostAddress::LocalHost, 0 ) );
+
+    capture( udp.localPort(), server.serverPort() );
+
+    FauxMoReplay replay;
+    QVERIFY( replay.load( file_ ) );
+    replay.setTarget( QHostAddress::LocalHost );
+    replay.setSpeed( 0 );
+
+    QSignalSpy finished( &replay, SIGNAL(finished()) );
+    replay.start();
+
+    //*** the search arrives as captured ***
+    QTRY_VERIFY( udp.hasPendingDatagrams() );
+    QByteArray datagram( int( udp.pendingDatagramSize() ), 0 );
+    udp.readDatagram( datagram.data(), datagram.size() );
+    QCOMPARE( datagram, QByteArray( SEARCH ) );
+
+    //*** so does the request - answer it and close, as a device does ***
+    QTRY_VERIFY( server.hasPendingConnections() );
+    QTcpSocket *sock = server.nextPendingConnection();
+
+    QTRY_VERIFY( sock->bytesAvailable() >= qint64(strlen( REQUEST )) );
+    QCOMPARE( sock->readAll(), QByteArray( REQUEST ) );
+
+    sock->write( RESPONSE );
+    sock->disconnectFromHost();
+
+    QTRY_COMPARE_WITH_TIMEOUT( finished.count(), 1, 5000 );
+
+    ReplayStats stats = replay.stats();
+    QCOMPARE( stats.datagrams, quint64(1) );
+    QCOMPARE( stats.requests, quint64(1) );
+    QCOMPARE( stats.responsesOk, quint64(1) );
+    QCOMPARE( stats.responsesBad, quint64(0) );
+    QCOMPARE( stats.noResponse, quint64(0) );
+}
+
+void TestCapture::replayAgainstInstance()
+{
+    //*** as captured from a normal instance - its first device gets the first automatic port ***
+    QByteArray set = QString( SET_REQUEST ).arg( int(strlen( SET_BODY )) ).arg( SET_BODY ).toUtf8();
+
+    QVERIFY( FauxMoCapture::start( file_ ) );
+    FauxMoCapture::record( FauxMoCapture::Http, PEER_IP, 50001, BASE_TCP_PORT, REQUEST, int(strlen( REQUEST )) );
+    FauxMoCapture::record( FauxMoCapture::Http, PEER_IP, 50002, BASE_TCP_PORT, set.constData(), set.size() );
+    FauxMoCapture::stop();
+
+    //*** the device at the captured port, as fauxmo-replay --serve sets it up ***
+    QString config = dir_.filePath( "devices.json" );
+    QFile f( config );
+    QVERIFY( f.open( QIODevice::WriteOnly | QIODevice::Truncate ) );
+    f.write( QString( "[ { \"name\": \"lamp\", \"port\": %1 } ]" ).arg( BASE_TCP_PORT ).toUtf8() );
+    f.close();
+
+    FauxMoQt fauxMo;
+    fauxMo.setInterfaces( QStringList() << "lo" );
+    QVERIFY( fauxMo.loadConfig( config, false ) );
+
+    QSignalSpy switched( &fauxMo, SIGNAL(setDeviceState(QString,bool)) );
+
+    FauxMoReplay replay;
+    QVERIFY( replay.load( file_ ) );
+    replay.setTarget( QHostAddress::LocalHost );
+    replay.setSpeed( 0 );
+
+    QSignalSpy finished( &replay, SIGNAL(finished()) );
+    replay.start();
+
+    QTRY_COMPARE_WITH_TIMEOUT( finished.count(), 1, 5000 );
+
+    ReplayStats stats = replay.stats();
+    QCOMPARE( stats.requests, quint64(2) );
+    QCOMPARE( stats.responsesOk, quint64(2) );
+    QCOMPARE( stats.connectErrors, quint64(0) );
+
+    QCOMPARE( switched.count(), 1 );
+    QCOMPARE( switched.first().at( 0 ).toString(), QString( "lamp" ) );
+    QCOMPARE( switched.first().at( 1 ).toBool(), true );
+}
+
+QTEST_GUILESS_MAIN(TestCapture)
+
+#include "tst_capture.moc"
@@ -0,0 +1,9 @@
+TARGET = tst_config
+
+QT += testlib
+CONFIG += testcase
+
+include(../../FauxMoApp.pri)
+
+SOURCES += \
+    tst_config.cpp
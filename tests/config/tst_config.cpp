@@ -0,0 +1,252 @@
+#include <QtTest>
+#include <QTemporaryDir>
+
+#include "FauxMoQt.h"
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief The TestConfig class - config file parsing and the diff applied on
+ *        reload. Devices are Hue lights unless a test needs ports, so nothing
+ *        listens.
+ */
+//*****************************************************************************
+class TestConfig : public QObject
+{
+    Q_OBJECT
+
+private slots:
+
+    void init();
+
+    void initialLoad();
+    void objectForm();
+    void unchanged();
+    void rename();
+    void remove();
+    void uuidChange();
+    void unreadable();
+    void invalidPorts();
+    void explicitPortSkipped();
+    void portInWorkerBlocks();
+
+private:
+
+    //*** writes the config file ***
+    void write( const QByteArray &json );
+
+    //*** (added, removed, renamed) of the last configApplied ***
+    static QList<int> counts( const QSignalSpy &spy );
+
+    QTemporaryDir dir_;
+    QString file_;
+};
+
+
+void TestConfig::init()
+{
+    QVERIFY( dir_.isValid() );
+    file_ = dir_.filePath( "devices.json" );
+}
+
+void TestConfig::write( const QByteArray &json )
+{
+    QFile f( file_ );
+    QVERIFY( f.open( QIODevice::WriteOnly | QIODevice::Truncate ) );
+    f.write( json );
+}
+
+QList<int> TestConfig::counts( const QSignalSpy &spy )
+{
+    if ( spy.isEmpty() ) return QList<int>();
+
+    const QList<QVariant> &args = spy.last();
+    return QList<int>() << args[0].toInt() << args[1].toInt() << args[2].toInt();
+}
+
+void TestConfig::initialLoad()
+{
+    FauxMoQt fauxMo;
+    fauxMo.setEmulationMode( FauxMoQt::HueMode );
+    QSignalSpy spy( &fauxMo, SIGNAL(configApplied(int,int,int)) );
+
+    write( "[ \"a\", \"b\", { \"id\": \"c\", \"name\": \"Cee\" } ]" );
+    QVERIFY( fauxMo.loadConfig( file_, false ) );
+
+    QCOMPARE( counts( spy ), QList<int>() << 3 << 0 << 0 );
+    QVERIFY( fauxMo.setState( "a", true ) );
+    QVERIFY( fauxMo.setState( "b", true ) );
+    QVERIFY( fauxMo.setState( "Cee", true ) );
+    QVERIFY( !fauxMo.setState( "c", true ) );
+}
+
+void TestConfig::objectForm()
+{
+    FauxMoQt fauxMo;
+    fauxMo.setEmulationMode( FauxMoQt::HueMode );
+    QSignalSpy spy( &fauxMo, SIGNAL(configApplied(int,int,int)) );
+
+    write( "{ \"devices\": [ \"a\", { \"name\": \"b\" }, { \"id\": \"nameless\" } ] }" );
+    QVERIFY( fauxMo.loadConfig( file_, false ) );
+
+    //*** entries without a name are skipped ***
+    QCOMPARE( counts( spy ), QList<int>() << 2 << 0 << 0 );
+    QVERIFY( fauxMo.setState( "a", true ) );
+    QVERIFY( fauxMo.setState( "b", true ) );
+}
+
+void TestConfig::unchanged()
+{
+    FauxMoQt fauxMo;
+    fauxMo.setEmulationMode( FauxMoQt::HueMode );
+    QSignalSpy spy( &fauxMo, SIGNAL(configApplied(int,int,int)) );
+
+    write( "[ \"a\", { \"id\": \"c\", \"name\": \"Cee\", \"uuid\": \"u-1\" } ]" );
+    QVERIFY( fauxMo.loadConfig( file_, false ) );
+    QVERIFY( fauxMo.loadConfig( file_, false ) );
+
+    QCOMPARE( spy.count(), 2 );
+    QCOMPARE( counts( spy ), QList<int>() << 0 << 0 << 0 );
+}
+
+void TestConfig::rename()
+{
+    FauxMoQt fauxMo;
+    fauxMo.setEmulationMode( FauxMoQt::HueMode );
+    QSignalSpy spy( &fauxMo, SIGNAL(configApplied(int,int,int)) );
+
+    write( "[ { \"id\": \"c\", \"name\": \"Cee\" } ]" );
+    QVERIFY( fauxMo.loadConfig( file_, false ) );
+
+    //*** same id, new name - renamed in place ***
+    write( "[ { \"id\": \"c\", \"name\": \"See\" } ]" );
+    QVERIFY( fauxMo.loadConfig( file_, false ) );
+
+    QCOMPARE( counts( spy ), QList<int>() << 0 << 0 << 1 );
+    QVERIFY( !fauxMo.setState( "Cee", true ) );
+    QVERIFY( fauxMo.setState( "See", true ) );
+}
+
+void TestConfig::remove()
+{
+    FauxMoQt fauxMo;
+    fauxMo.setEmulationMode( FauxMoQt::HueMode );
+    QSignalSpy spy( &fauxMo, SIGNAL(configApplied(int,int,int)) );
+
+    write( "[ \"a\", \"b\" ]" );
+    QVERIFY( fauxMo.loadConfig( file_, false ) );
+
+    write( "[ \"a\" ]" );
+    QVERIFY( fauxMo.loadConfig( file_, false ) );
+
+    QCOMPARE( counts( spy ), QList<int>() << 0 << 1 << 0 );
+    QVERIFY( fauxMo.setState( "a", true ) );
+    QVERIFY( !fauxMo.setState( "b", true ) );
+
+    //*** devices added by the program are not the config's to remove ***
+    fauxMo.addDevice( "manual" );
+    write( "[]" );
+    QVERIFY( fauxMo.loadConfig( file_, false ) );
+
+    QCOMPARE( counts( spy ), QList<int>() << 0 << 1 << 0 );
+    QVERIFY( fauxMo.setState( "manual", true ) );
+}
+
+void TestConfig::uuidChange()
+{
+    FauxMoQt fauxMo;
+    fauxMo.setEmulationMode( FauxMoQt::HueMode );
+    QSignalSpy spy( &fauxMo, SIGNAL(configApplied(int,int,int)) );
+
+    write( "[ { \"name\": \"a\", \"uuid\": \"u-1\" } ]" );
+    QVERIFY( fauxMo.loadConfig( file_, false ) );
+
+    //*** a new uuid is a new device to the controllers ***
+    write( "[ { \"name\": \"a\", \"uuid\": \"u-2\" } ]" );
+    QVERIFY( fauxMo.loadConfig( file_, false ) );
+
+    QCOMPARE( counts( spy ), QList<int>() << 1 << 1 << 0 );
+    QVERIFY( fauxMo.setState( "a", true ) );
+}
+
+void TestConfig::unreadable()
+{
+    FauxMoQt fauxMo;
+    fauxMo.setEmulationMode( FauxMoQt::HueMode );
+    QSignalSpy spy( &fauxMo, SIGNAL(configApplied(int,int,int)) );
+
+    write( "[ \"a\" ]" );
+    QVERIFY( fauxMo.loadConfig( file_, false ) );
+
+    //*** devices are left alone ***
+    write( "[ \"a\", " );
+    QVERIFY( !fauxMo.loadConfig( file_, false ) );
+    QVERIFY( !fauxMo.loadConfig( dir_.filePath( "missing.json" ), false ) );
+
+    QCOMPARE( spy.count(), 1 );
+    QVERIFY( fauxMo.setState( "a", true ) );
+}
+
+void TestConfig::invalidPorts()
+{
+    FauxMoQt fauxMo;
+    QSignalSpy spy( &fauxMo, SIGNAL(configApplied(int,int,int)) );
+
+    write( "[ { \"name\": \"zero\", \"port\": 0 },"
+           "  { \"name\": \"big\", \"port\": 70000 },"
+           "  { \"name\": \"text\", \"port\": \"80\" } ]" );
+    QVERIFY( fauxMo.loadConfig( file_, false ) );
+
+    QCOMPARE( counts( spy ), QList<int>() << 0 << 0 << 0 );
+    QVERIFY( !fauxMo.setState( "zero", true ) );
+    QVERIFY( !fauxMo.setState( "big", true ) );
+    QVERIFY( !fauxMo.setState( "text", true ) );
+}
+
+void TestConfig::explicitPortSkipped()
+{
+    FauxMoQt fauxMo;
+    QSignalSpy spy( &fauxMo, SIGNAL(configApplied(int,int,int)) );
+
+    //*** the first automatic port, as in a capture of a normal instance ***
+    write( QString( "[ { \"name\": \"a\", \"port\": %1 } ]" ).arg( BASE_TCP_PORT ).toUtf8() );
+    QVERIFY( fauxMo.loadConfig( file_, false ) );
+
+    QCOMPARE( counts( spy ), QList<int>() << 1 << 0 << 0 );
+    QVERIFY( fauxMo.setState( "a", true ) );
+
+    //*** would fail to listen if it were given the same port ***
+    fauxMo.addDevice( "b" );
+    QVERIFY( fauxMo.setState( "b", true ) );
+}
+
+void TestConfig::portInWorkerBlocks()
+{
+QStringList names;
+
+    FauxMoQt fauxMo;
+    QVERIFY( fauxMo.setWorker( 0, 2 ) );
+    QSignalSpy spy( &fauxMo, SIGNAL(configApplied(int,int,int)) );
+
+    //*** names this worker owns, so only the port decides ***
+    for ( int i = 0; names.size() < 2; i++ )
+    {
+        QString name = QString( "dev-%1" ).arg( i );
+        if ( FauxMoQt::workerFor( name, 2 ) == 0 ) names << name;
+    }
+
+    //*** ours and the other worker's block - either may be handed out ***
+    write( QString( "[ { \"name\": \"%1\", \"port\": %2 }, { \"name\": \"%3\", \"port\": %4 } ]" )
+           .arg( names[0] ).arg( BASE_TCP_PORT + 1 )
+           .arg( names[1] ).arg( BASE_TCP_PORT + DEFAULT_PORT_BLOCK + 1 ).toUtf8() );
+    QVERIFY( fauxMo.loadConfig( file_, false ) );
+
+    QCOMPARE( counts( spy ), QList<int>() << 0 << 0 << 0 );
+    QVERIFY( !fauxMo.setState( names[0], true ) );
+    QVERIFY( !fauxMo.setState( names[1], true ) );
+}
+
+QTEST_GUILESS_MAIN(TestConfig)
+
+#include "tst_config.moc"
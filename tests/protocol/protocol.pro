@@ -0,0 +1,9 @@
+TARGET = tst_protocol
+
+QT += testlib
+CONFIG += testcase
+
+include(../../FauxMoApp.pri)
+
+SOURCES += \
+    tst_protocol.cpp
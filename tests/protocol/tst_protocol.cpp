@@ -0,0 +1,212 @@
+#include <QtTest>
+
+#include "FauxMoProtocol.h"
+
+//*** a search for 'target' ***
+static QByteArray search( const char *target )
+{
+    return QByteArray( "M-SEARCH * HTTP/1.1\r\n"
+                       "HOST: 239.255.255.250:1900\r\n"
+                       "MAN: \"ssdp:discover\"\r\n"
+                       "MX: 1\r\n"
+                       "ST: " ) + target + "\r\n\r\n";
+}
+
+//*** a basicevent1 control request ***
+static QByteArray action( const char *name, const char *args = "" )
+{
+    QByteArray body = QString( "<?xml version=\"1.0\" encoding=\"utf-8\"?>"
+                               "<s:Envelope xmlns:s=\"http://schemas.xmlsoap.org/soap/envelope/\"><s:Body>"
+                               "<u:%1 xmlns:u=\"urn:Belkin:service:basicevent:1\">%2</u:%1>"
+                               "</s:Body></s:Envelope>" ).arg( name ).arg( args ).toUtf8();
+
+    return QString( "POST /upnp/control/basicevent1 HTTP/1.1\r\n"
+                    "Content-Type: text/xml; charset=\"utf-8\"\r\n"
+                    "SOAPACTION: \"urn:Belkin:service:basicevent:1#%1\"\r\n"
+                    "Content-Length: %2\r\n"
+                    "\r\n" ).arg( name ).arg( body.size() ).toUtf8() + body;
+}
+
+//*** body of a response, checked against its Content-Length ***
+static QByteArray responseBody( const QByteArray &response )
+{
+    int hdrEnd = response.indexOf( "\r\n\r\n" );
+    if ( !response.startsWith( "HTTP/1.1 200 OK\r\n" ) || hdrEnd < 0 ) return QByteArray();
+
+    QByteArray body = response.mid( hdrEnd + 4 );
+    if ( FauxMoProtocol::contentLength( response.constData(), hdrEnd ) != body.size() ) return QByteArray();
+
+    return body;
+}
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief The TestProtocol class - SSDP classification, header scanning and
+ *        the Wemo request handler
+ */
+//*****************************************************************************
+class TestProtocol : public QObject
+{
+    Q_OBJECT
+
+private slots:
+
+    void classifySearch_data();
+    void classifySearch();
+    void searchTarget();
+
+    void contentLength_data();
+    void contentLength();
+
+    void setup();
+    void binaryState();
+    void friendlyName();
+    void unknownRequest();
+    void responseAppended();
+};
+
+
+void TestProtocol::classifySearch_data()
+{
+    QTest::addColumn<QByteArray>( "datagram" );
+    QTest::addColumn<int>( "target" );
+
+    QTest::newRow( "wemo" )     << search( "urn:Belkin:device:controllee:1" ) << int(SsdpWemo);
+    QTest::newRow( "root" )     << search( "upnp:rootdevice" ) << int(SsdpRootDevice);
+    QTest::newRow( "all" )      << search( "ssdp:all" ) << int(SsdpAll);
+    QTest::newRow( "hue" )      << search( "urn:schemas-upnp-org:device:basic:1" ) << int(SsdpHue);
+    QTest::newRow( "other" )    << search( "urn:dial-multiscreen-org:service:dial:1" ) << int(SsdpNone);
+    QTest::newRow( "no ST" )    << QByteArray( "M-SEARCH * HTTP/1.1\r\nMX: 1\r\n\r\n" ) << int(SsdpNone);
+    QTest::newRow( "notify" )   << QByteArray( "NOTIFY * HTTP/1.1\r\nNT: upnp:rootdevice\r\n\r\n" ) << int(SsdpNone);
+    QTest::newRow( "ST only" )  << QByteArray( "ST: ssdp:all\r\n\r\n" ) << int(SsdpNone);
+    QTest::newRow( "empty" )    << QByteArray() << int(SsdpNone);
+}
+
+void TestProtocol::classifySearch()
+{
+    QFETCH( QByteArray, datagram );
+    QFETCH( int, target );
+
+    QCOMPARE( int( FauxMoProtocol::classifySearch( datagram.constData(), datagram.size() ) ), target );
+}
+
+void TestProtocol::searchTarget()
+{
+    QCOMPARE( QByteArray( FauxMoProtocol::searchTarget( SsdpWemo ) ), QByteArray( "urn:Belkin:device:controllee:1" ) );
+    QCOMPARE( QByteArray( FauxMoProtocol::searchTarget( SsdpHue ) ), QByteArray( "urn:schemas-upnp-org:device:basic:1" ) );
+    QCOMPARE( QByteArray( FauxMoProtocol::searchTarget( SsdpNone ) ), QByteArray() );
+    QCOMPARE( QByteArray( FauxMoProtocol::searchTarget( SsdpTargetCount ) ), QByteArray() );
+}
+
+void TestProtocol::contentLength_data()
+{
+    QTest::addColumn<QByteArray>( "header" );
+    QTest::addColumn<qint64>( "length" );
+
+    QTest::newRow( "plain" )        << QByteArray( "POST / HTTP/1.1\r\nContent-Length: 42\r\n" ) << qint64(42);
+    QTest::newRow( "upper case" )   << QByteArray( "POST / HTTP/1.1\r\nCONTENT-LENGTH: 7\r\n" ) << qint64(7);
+    QTest::newRow( "no space" )     << QByteArray( "POST / HTTP/1.1\r\ncontent-length:123\r\n" ) << qint64(123);
+    QTest::newRow( "first line" )   << QByteArray( "Content-Length: 5\r\n" ) << qint64(5);
+    QTest::newRow( "absent" )       << QByteArray( "GET / HTTP/1.1\r\nHost: x\r\n" ) << qint64(0);
+    QTest::newRow( "not a number" ) << QByteArray( "POST / HTTP/1.1\r\nContent-Length: 1x\r\n" ) << qint64(0);
+    QTest::newRow( "mid line" )     << QByteArray( "POST / HTTP/1.1\r\nX-Content-Length: 9\r\n" ) << qint64(0);
+    QTest::newRow( "cut short" )    << QByteArray( "POST / HTTP/1.1\r\nContent-Len" ) << qint64(0);
+}
+
+void TestProtocol::contentLength()
+{
+    QFETCH( QByteArray, header );
+    QFETCH( qint64, length );
+
+    QCOMPARE( FauxMoProtocol::contentLength( header.constData(), header.size() ), length );
+}
+
+void TestProtocol::setup()
+{
+    WemoProtocol protocol( "kitchen", "abc-123" );
+    QByteArray request( "GET /setup.xml HTTP/1.1\r\nHost: 127.0.0.1:19125\r\n\r\n" );
+    QByteArray out;
+
+    QCOMPARE( protocol.handleRequest( request.constData(), request.size(), out ), WemoProtocol::Response );
+
+    QByteArray body = responseBody( out );
+    QVERIFY( body.contains( "<friendlyName>kitchen</friendlyName>" ) );
+    QVERIFY( body.contains( "abc-123" ) );
+
+    //*** rendered again after a rename ***
+    protocol.setName( "pantry" );
+    out.clear();
+    protocol.handleRequest( request.constData(), request.size(), out );
+    QVERIFY( responseBody( out ).contains( "<friendlyName>pantry</friendlyName>" ) );
+}
+
+void TestProtocol::binaryState()
+{
+    WemoProtocol protocol( "lamp", "abc-123" );
+    QByteArray out;
+
+    QByteArray get = action( "GetBinaryState" );
+    QCOMPARE( protocol.handleRequest( get.constData(), get.size(), out ), WemoProtocol::Response );
+    QVERIFY( responseBody( out ).contains( "<BinaryState>0</BinaryState>" ) );
+
+    QByteArray on = action( "SetBinaryState", "<BinaryState>1</BinaryState>" );
+    out.clear();
+    QCOMPARE( protocol.handleRequest( on.constData(), on.size(), out ), WemoProtocol::StateSet );
+    QVERIFY( protocol.state() );
+    QVERIFY( responseBody( out ).contains( "<BinaryState>1</BinaryState>" ) );
+
+    out.clear();
+    protocol.handleRequest( get.constData(), get.size(), out );
+    QVERIFY( responseBody( out ).contains( "<BinaryState>1</BinaryState>" ) );
+
+    QByteArray off = action( "SetBinaryState", "<BinaryState>0</BinaryState>" );
+    out.clear();
+    QCOMPARE( protocol.handleRequest( off.constData(), off.size(), out ), WemoProtocol::StateSet );
+    QVERIFY( !protocol.state() );
+
+    //*** answered with the current state, but nothing was set ***
+    QByteArray bad = action( "SetBinaryState", "<BinaryState>7</BinaryState>" );
+    out.clear();
+    QCOMPARE( protocol.handleRequest( bad.constData(), bad.size(), out ), WemoProtocol::Response );
+    QVERIFY( !protocol.state() );
+}
+
+void TestProtocol::friendlyName()
+{
+    WemoProtocol protocol( "porch", "abc-123" );
+    QByteArray request = action( "GetFriendlyName" );
+    QByteArray out;
+
+    QCOMPARE( protocol.handleRequest( request.constData(), request.size(), out ), WemoProtocol::Response );
+    QVERIFY( responseBody( out ).contains( "<FriendlyName>porch</FriendlyName>" ) );
+}
+
+void TestProtocol::unknownRequest()
+{
+    WemoProtocol protocol( "lamp", "abc-123" );
+    QByteArray request( "GET /favicon.ico HTTP/1.1\r\n\r\n" );
+    QByteArray out;
+
+    QCOMPARE( protocol.handleRequest( request.constData(), request.size(), out ), WemoProtocol::NoResponse );
+    QVERIFY( out.isEmpty() );
+
+    QCOMPARE( protocol.handleRequest( nullptr, 0, out ), WemoProtocol::NoResponse );
+    QVERIFY( out.isEmpty() );
+}
+
+void TestProtocol::responseAppended()
+{
+    WemoProtocol protocol( "lamp", "abc-123" );
+    QByteArray request = action( "GetBinaryState" );
+    QByteArray out( "prefix" );
+
+    protocol.handleRequest( request.constData(), request.size(), out );
+
+    QVERIFY( out.startsWith( "prefixHTTP/1.1 200 OK\r\n" ) );
+}
+
+QTEST_GUILESS_MAIN(TestProtocol)
+
+#include "tst_protocol.moc"
@@ -0,0 +1,8 @@
+# QtTest checks - one program per area, run with 'make check'
+TEMPLATE = subdirs
+
+SUBDIRS += \
+    capture \
+    config \
+    protocol \
+    worker
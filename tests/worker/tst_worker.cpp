@@ -0,0 +1,146 @@
+#include <QtTest>
+
+#include "FauxMoQt.h"
+
+
+//*****************************************************************************
+//*****************************************************************************
+/**
+ * @brief The TestWorker class - scale-out partitioning. Every worker process
+ *        must map a name to the same worker, so the hash values are pinned.
+ */
+//*****************************************************************************
+class TestWorker : public QObject
+{
+    Q_OBJECT
+
+private slots:
+
+    void workerFor_data();
+    void workerFor();
+    void singleWorker();
+    void inRange();
+    void spread();
+    void partition();
+    void addDeviceKeepsOwn();
+    void setWorkerChecks();
+};
+
+
+void TestWorker::workerFor_data()
+{
+    QTest::addColumn<QString>( "name" );
+    QTest::addColumn<int>( "count" );
+    QTest::addColumn<int>( "worker" );
+
+    //*** FNV-1a of the UTF-8 name, modulo count ***
+    QTest::newRow( "empty" )    << QString() << 3 << 1;
+    QTest::newRow( "a" )        << QString( "a" ) << 3 << 1;
+    QTest::newRow( "kitchen" )  << QString( "kitchen light" ) << 4 << 3;
+    QTest::newRow( "utf-8" )    << QString::fromUtf8( "K\xc3\xbc" "che" ) << 5 << 1;
+    QTest::newRow( "porch" )    << QString( "porch" ) << 7 << 6;
+}
+
+void TestWorker::workerFor()
+{
+    QFETCH( QString, name );
+    QFETCH( int, count );
+    QFETCH( int, worker );
+
+    QCOMPARE( FauxMoQt::workerFor( name, count ), worker );
+}
+
+void TestWorker::singleWorker()
+{
+    QCOMPARE( FauxMoQt::workerFor( "porch", 1 ), 0 );
+    QCOMPARE( FauxMoQt::workerFor( "porch", 0 ), 0 );
+    QCOMPARE( FauxMoQt::workerFor( "porch", -2 ), 0 );
+}
+
+void TestWorker::inRange()
+{
+    for ( int count = 2; count <= 16; count++ )
+    {
+        for ( int i = 0; i < 200; i++ )
+        {
+            int w = FauxMoQt::workerFor( QString( "device-%1" ).arg( i ), count );
+            QVERIFY( w >= 0 && w < count );
+        }
+    }
+}
+
+void TestWorker::spread()
+{
+    const int names   = 4000;
+    const int workers = 4;
+    int per[workers] = {};
+
+    for ( int i = 0; i < names; i++ )
+        per[FauxMoQt::workerFor( QString( "device-%1" ).arg( i ), workers )]++;
+
+    //*** within 10% of an even share ***
+    for ( int w = 0; w < workers; w++ )
+    {
+        QVERIFY2( per[w] > names / workers * 9 / 10 && per[w] < names / workers * 11 / 10,
+                  qPrintable( QString( "worker %1 got %2" ).arg( w ).arg( per[w] ) ) );
+    }
+}
+
+void TestWorker::partition()
+{
+    const int workers = 3;
+    FauxMoQt fauxMo[workers];
+
+    for ( int w = 0; w < workers; w++ )
+        QVERIFY( fauxMo[w].setWorker( w, workers ) );
+
+    //*** every name has exactly one owner ***
+    for ( int i = 0; i < 300; i++ )
+    {
+        QString name = QString( "device-%1" ).arg( i );
+        int owners = 0;
+
+        for ( int w = 0; w < workers; w++ )
+            if ( fauxMo[w].ownsDevice( name ) ) owners++;
+
+        QCOMPARE( owners, 1 );
+        QVERIFY( fauxMo[FauxMoQt::workerFor( name, workers )].ownsDevice( name ) );
+    }
+}
+
+void TestWorker::addDeviceKeepsOwn()
+{
+    FauxMoQt fauxMo;
+    fauxMo.setEmulationMode( FauxMoQt::HueMode );
+    QVERIFY( fauxMo.setWorker( 1, 2 ) );
+
+    for ( int i = 0; i < 50; i++ )
+    {
+        QString name = QString( "device-%1" ).arg( i );
+        fauxMo.addDevice( name );
+
+        QCOMPARE( fauxMo.setState( name, true ), FauxMoQt::workerFor( name, 2 ) == 1 );
+    }
+}
+
+void TestWorker::setWorkerChecks()
+{
+    FauxMoQt fauxMo;
+    fauxMo.setEmulationMode( FauxMoQt::HueMode );
+
+    QVERIFY( !fauxMo.setWorker( 2, 2 ) );
+    QVERIFY( !fauxMo.setWorker( -1, 2 ) );
+    QVERIFY( !fauxMo.setWorker( 0, 0 ) );
+    QVERIFY( !fauxMo.setWorker( 0, 2, 0 ) );
+
+    //*** block would run past port 65535 ***
+    QVERIFY( !fauxMo.setWorker( 50, 64, 1000 ) );
+
+    //*** the partition can't change under existing devices ***
+    fauxMo.addDevice( "a" );
+    QVERIFY( !fauxMo.setWorker( 0, 2 ) );
+}
+
+QTEST_GUILESS_MAIN(TestWorker)
+
+#include "tst_worker.moc"
@@ -0,0 +1,9 @@
+TARGET = tst_worker
+
+QT += testlib
+CONFIG += testcase
+
+include(../../FauxMoApp.pri)
+
+SOURCES += \
+    tst_worker.cpp